@@ -21,6 +21,7 @@
 #include "client.h"
 #include "output.h"
 #include "cursor.h"
+#include "transaction.h"
 #include "utils.h"
 
 /* action ressources */
@@ -44,7 +45,7 @@ bool bindings_cursor_motion(struct jwc_server *server, double *x, double *y)
 		if (server->cursor_button_left_pressed) {
 
 			/* change transparency of the client */
-			target->alpha = 0.7;
+			client_set_alpha(target, 0.7);
 
 			/* calculate target coordinates based on
 			 * client geometry.
@@ -103,7 +104,9 @@ bool bindings_cursor_button(struct jwc_server *server)
 		if (server->cursor_button_left_released ||
 		    server->cursor_button_right_released) {
 			action_ongoing = false;
-			target->alpha = 1;
+			output_set_drag_client(server, NULL);
+			client_flush_configures(server);
+			client_set_alpha(target, 1);
 			target = NULL;
 		}
 		return true;
@@ -132,6 +135,8 @@ bool bindings_cursor_button(struct jwc_server *server)
 		    server->cursor_button_right_pressed) {
 			action_ongoing = true;
 			target = focus;
+			if (server->cursor_button_left_pressed)
+				output_set_drag_client(server, focus);
 			return true;
 		}
 	}
@@ -166,8 +171,10 @@ bool bindings_keyboard(struct jwc_server *server, xkb_keysym_t syms)
 			output_get_output_geo_at(server, box.x, box.y, &output_geo);
 
 			/* move and resize client to right output */
+			transaction_begin(server);
 			client_move_resize(focus, output_geo.x + (output_geo.width / 2), 0,
 					   output_geo.width / 2, output_geo.height);
+			transaction_commit(server);
 			move_cursor_center_client(focus);
 
 			/* reset some client ressources */
@@ -184,8 +191,10 @@ bool bindings_keyboard(struct jwc_server *server, xkb_keysym_t syms)
 			output_get_output_geo_at(server, box.x, box.y, &output_geo);
 
 			/* move and resize client to left output */
+			transaction_begin(server);
 			client_move_resize(focus, output_geo.x, 0,
 					   output_geo.width / 2, output_geo.height);
+			transaction_commit(server);
 			move_cursor_center_client(focus);
 
 			/* reset some client ressources */
@@ -204,6 +213,8 @@ bool bindings_keyboard(struct jwc_server *server, xkb_keysym_t syms)
 	case XKB_KEY_a:
 		wl_list_for_each(focus, &server->clients, link) {
 			focus->visible = true;
+			client_update_outputs(focus);
+			client_damage_whole(focus);
 		}
 		break;
 
@@ -239,6 +250,18 @@ bool bindings_keyboard(struct jwc_server *server, xkb_keysym_t syms)
 		}
 		break;
 
+	case XKB_KEY_i:
+		/* process each pointer event instead of once per dispatch */
+		cursor_set_coalesce(server, !server->cursor_coalesce);
+		break;
+
+	case XKB_KEY_l:
+		/* present the fullscreen client scanned out as soon as it commits */
+		focus = client_get_focus(server);
+		if (focus != NULL && focus->output != NULL)
+			output_set_low_latency(focus->output, !focus->output->low_latency);
+		break;
+
 	case XKB_KEY_m:
 		focus = client_get_focus(server);
 		if (focus != NULL && !focus->fullscreen) {
@@ -20,25 +20,66 @@
 #include "client.h"
 #include "keyboard.h"
 #include "output.h"
+#include "transaction.h"
 #include "utils.h"
 
 struct render_data {
 	struct wlr_output *output;
 	struct wlr_renderer *renderer;
 	struct jwc_client *client;
-	struct timespec *when;
+	double ox, oy;
+};
+
+struct occlusion_data {
+	struct jwc_client *client;
+	pixman_region32_t *region;
+	double ox, oy;
+};
+
+struct presentation_data {
+	struct wlr_presentation *presentation;
+	struct wlr_presentation_event *event;
+};
+
+struct damage_data {
+	struct jwc_client *client;
+	bool whole;
 };
 
 /* client init function declaration */
 void xdg_shell_v6_init(struct jwc_server *server);
 void xwayland_init(struct jwc_server *server);
+void xwayland_flush_configures(struct jwc_server *server);
+
+static void render_texture(struct render_data *rdata, struct wlr_texture *texture,
+			   double ox, double oy, int width, int height)
+{
+	struct jwc_client *client = rdata->client;
+	struct wlr_output *output = rdata->output;
+
+	/* only repaint the damaged part of the surface not hidden by the
+	 * clients above it
+	 */
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, ox, oy, width, height);
+	pixman_region32_intersect(&damage, &damage, &client->render_region);
+
+	/* render the client texture */
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		output_scissor(output, &rects[i]);
+		wlr_render_texture(rdata->renderer, texture, output->transform_matrix,
+				   ox, oy, client->alpha);
+	}
+	pixman_region32_fini(&damage);
+}
 
 static void render_surface(struct wlr_surface *surface, int sx, int sy, void *data)
 {
 	struct render_data *rdata = data;
 	struct jwc_client *client = rdata->client;
 	struct wlr_output *output = rdata->output;
-	struct wlr_output_layout *output_layout = client->server->output_layout;
 
 	/* get texture of the surface */
 	struct wlr_texture *texture = wlr_surface_get_texture(surface);
@@ -46,31 +87,303 @@ static void render_surface(struct wlr_surface *surface, int sx, int sy, void *da
 		return;
 
 	/* calculate origin coordinates */
-	double ox = 0, oy = 0;
-	wlr_output_layout_output_coords(output_layout, output, &ox, &oy);
-	ox += client->x + sx;
-	oy += client->y + sy;
+	double ox = rdata->ox + client->x + sx;
+	double oy = rdata->oy + client->y + sy;
 
-	/* render the client texture */
-	wlr_render_texture(rdata->renderer, texture, output->transform_matrix, ox, oy,
-			   client->alpha);
+	render_texture(rdata, texture, ox, oy, surface->current.width,
+		       surface->current.height);
 
-	wlr_surface_send_frame_done(surface, rdata->when);
+	/* presentation feedback is reported by the primary output */
+	if (client->output && client->output->wlr_output == output)
+		wlr_presentation_surface_sampled(client->server->presentation, surface);
 }
 
-static bool client_exist(struct jwc_server *server, struct jwc_client *client)
+static void render_saved_buffers(struct render_data *rdata)
 {
-	struct wl_list *clients = &server->clients;
-	if (wl_list_empty(clients))
-		return NULL;
+	struct jwc_client *client = rdata->client;
+
+	/* the surfaces have not drawn their new state yet, nothing is sampled */
+	for (int i = 0; i < client->saved_len; i++) {
+		struct jwc_saved_buffer *saved = &client->saved_buffers[i];
+
+		render_texture(rdata, saved->buffer->texture,
+			       rdata->ox + saved->box.x, rdata->oy + saved->box.y,
+			       saved->box.width, saved->box.height);
+	}
+}
+
+static void occlude_surface(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	struct occlusion_data *odata = data;
+	struct jwc_client *client = odata->client;
+
+	/* opaque region is in surface-local coordinates */
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	pixman_region32_copy(&opaque, &surface->opaque_region);
+	pixman_region32_translate(&opaque, odata->ox + client->x + sx,
+				  odata->oy + client->y + sy);
+	pixman_region32_subtract(odata->region, odata->region, &opaque);
+	pixman_region32_fini(&opaque);
+}
 
-	struct jwc_client *tmp;
-	wl_list_for_each(tmp, clients, link) {
-		if (&tmp->link == &client->link)
-			return true;
+static void count_surface(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	int *count = data;
+	(*count)++;
+}
+
+static void extents_surface(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	struct wlr_box *box = data;
+	int x1 = MIN(box->x, sx);
+	int y1 = MIN(box->y, sy);
+	int x2 = MAX(box->x + box->width, sx + surface->current.width);
+	int y2 = MAX(box->y + box->height, sy + surface->current.height);
+
+	box->x = x1;
+	box->y = y1;
+	box->width = x2 - x1;
+	box->height = y2 - y1;
+}
+
+static void save_surface(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	struct jwc_client *client = data;
+	struct jwc_saved_buffer *saved;
+
+	if (!wlr_surface_has_buffer(surface) || !surface->buffer->texture)
+		return;
+
+	if (client->saved_len == client->saved_size) {
+		int size = client->saved_size ? client->saved_size * 2 : 4;
+		saved = realloc(client->saved_buffers, size * sizeof(*saved));
+		if (!saved) {
+			ERROR("Failed to allocate saved buffers");
+			return;
+		}
+		client->saved_buffers = saved;
+		client->saved_size = size;
+	}
+
+	/* the buffer is kept alive until the transaction is released */
+	saved = &client->saved_buffers[client->saved_len++];
+	wlr_buffer_ref(&surface->buffer->base);
+	saved->buffer = surface->buffer;
+	saved->box.x = client->x + sx;
+	saved->box.y = client->y + sy;
+	saved->box.width = surface->current.width;
+	saved->box.height = surface->current.height;
+}
+
+static void frame_done_surface(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	wlr_surface_send_frame_done(surface, data);
+}
+
+static void presented_surface(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	struct presentation_data *pdata = data;
+	wlr_presentation_send_surface_presented(pdata->presentation, surface, pdata->event);
+}
+
+static void damage_surface(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	struct damage_data *ddata = data;
+	struct jwc_client *client = ddata->client;
+	struct jwc_server *server = client->server;
+	int x = client->x + sx;
+	int y = client->y + sy;
+
+	/* the surface area has changed: damage the old and the new one */
+	if (ddata->whole ||
+	    surface->current.width != surface->previous.width ||
+	    surface->current.height != surface->previous.height) {
+		struct wlr_box box = {
+			.x = x,
+			.y = y,
+			.width = MAX(surface->current.width, surface->previous.width),
+			.height = MAX(surface->current.height, surface->previous.height),
+		};
+		output_damage_box(server, &box);
+	} else {
+		/* only damage what the client has updated */
+		pixman_region32_t damage;
+		pixman_region32_init(&damage);
+		wlr_surface_get_effective_damage(surface, &damage);
+		if (pixman_region32_not_empty(&damage)) {
+			pixman_region32_translate(&damage, x, y);
+			output_damage_region(server, &damage);
+		}
+		pixman_region32_fini(&damage);
 	}
 
-	return false;
+	/* frame events are only sent by the primary output, which may not be
+	 * damaged at all when the client only updated another output.
+	 */
+	if (!wl_list_empty(&surface->current.frame_callback_list) && client->output)
+		wlr_output_schedule_frame(client->output->wlr_output);
+}
+
+void client_damage_whole(struct jwc_client *client)
+{
+	struct damage_data ddata = {
+		.client = client,
+		.whole = true,
+	};
+
+	if (!client->mapped || !client->visible)
+		return;
+
+	client->ops->for_each_surface(client, damage_surface, &ddata);
+
+	/* clients below the dragged one have changed */
+	if (client != client->server->drag_client)
+		output_invalidate_drag_cache(client->server, client->output_mask);
+}
+
+void client_commit(struct jwc_client *client)
+{
+	struct damage_data ddata = {
+		.client = client,
+		.whole = false,
+	};
+
+	/* the surface geometry may have changed */
+	client_invalidate_geometry(client);
+
+	if (!client->mapped || !client->visible)
+		return;
+
+	client->ops->for_each_surface(client, damage_surface, &ddata);
+	client_update_outputs(client);
+
+	/* clients below the dragged one have changed */
+	if (client != client->server->drag_client)
+		output_invalidate_drag_cache(client->server, client->output_mask);
+
+	if (client->fullscreen && client->output)
+		output_client_commit(client->output, client);
+}
+
+void client_save_buffers(struct jwc_client *client)
+{
+	client_drop_saved_buffers(client);
+	client->ops->for_each_surface(client, save_surface, client);
+	client->saved_extents = client->extents;
+	client->saved_mask = client->output_mask;
+}
+
+void client_drop_saved_buffers(struct jwc_client *client)
+{
+	/* the previous state is not displayed anymore */
+	if (client->saved_len > 0)
+		output_damage_box(client->server, &client->saved_extents);
+
+	for (int i = 0; i < client->saved_len; i++)
+		wlr_buffer_unref(&client->saved_buffers[i].buffer->base);
+	client->saved_len = 0;
+	client->saved_mask = 0;
+}
+
+static void client_get_extents(struct jwc_client *client, struct wlr_box *box)
+{
+	/* area covered by all the surfaces (subsurfaces, popups) of the client */
+	box->x = 0;
+	box->y = 0;
+	box->width = 0;
+	box->height = 0;
+	client->ops->for_each_surface(client, extents_surface, box);
+	box->x += client->x;
+	box->y += client->y;
+}
+
+static void client_update_grid(struct jwc_client *client)
+{
+	struct wlr_box box = {0};
+
+	/* an empty box removes the client from the grid */
+	if (client->mapped && client->visible)
+		client_get_geometry(client, &box);
+
+	if (!grid_update(client->server->client_grid, &client->grid_item, &box))
+		ERROR("Failed to allocate clients grid cell");
+}
+
+static void client_update_stack(struct jwc_server *server)
+{
+	struct jwc_client *client;
+	int index = 0;
+
+	wl_list_for_each(client, &server->clients, link)
+		client->grid_item.stack_index = index++;
+
+	grid_restack(server->client_grid);
+	server->clients_stack_dirty = false;
+}
+
+void client_update_outputs(struct jwc_client *client)
+{
+	struct jwc_server *server = client->server;
+	struct wlr_box *box = &client->extents;
+	uint32_t output_mask = 0;
+
+	client->output = NULL;
+	if (client->mapped && client->visible) {
+		client_get_extents(client, box);
+		output_mask = output_get_mask(server, box);
+
+		/* frame events are only sent by the output displaying the
+		 * biggest part of the client
+		 */
+		client->output = output_get_primary_at(server, box);
+	}
+
+	/* the outputs still displaying the previous state */
+	if (client->in_transaction)
+		output_mask |= client->saved_mask;
+
+	/* only the outputs entered or left have to update their clients,
+	 * the others only refresh the entry of this client.
+	 */
+	if (output_mask != client->output_mask) {
+		output_set_clients_dirty(server, output_mask ^ client->output_mask);
+		client->output_mask = output_mask;
+	}
+	output_update_client(client);
+
+	client_update_grid(client);
+}
+
+static struct wl_list *client_get_surface_bucket(struct jwc_server *server,
+						  struct wlr_surface *surface)
+{
+	/* surfaces are heap allocated, the lowest bits are always the same */
+	uintptr_t key = (uintptr_t)surface >> 4;
+
+	return &server->client_surfaces[(key ^ (key >> 8)) % CLIENT_SURFACE_BUCKETS];
+}
+
+static void client_index_surface(struct jwc_client *client)
+{
+	struct wl_list *bucket;
+
+	/* the surface may have changed since the last map (i.e. X11 windows) */
+	if (client->indexed)
+		wl_list_remove(&client->surface_link);
+
+	bucket = client_get_surface_bucket(client->server, client->surface);
+	wl_list_insert(bucket, &client->surface_link);
+	client->indexed = true;
+}
+
+static void client_unindex_surface(struct jwc_client *client)
+{
+	if (!client->indexed)
+		return;
+
+	wl_list_remove(&client->surface_link);
+	client->indexed = false;
 }
 
 void client_setup(struct jwc_client *client)
@@ -79,10 +392,15 @@ void client_setup(struct jwc_client *client)
 
 	/* by default client has no transparency */
 	client->alpha = 1;
+	client_invalidate_geometry(client);
 
 	/* add this client to the clients server list */
-	if (!client_exist(server, client))
+	if (!client->in_list) {
 		wl_list_insert(&server->clients, &client->link);
+		client->in_list = true;
+		server->clients_stack_dirty = true;
+	}
+	client_index_surface(client);
 
 	/* focus and show on toplevel */
 	client_set_focus(client);
@@ -90,14 +408,36 @@ void client_setup(struct jwc_client *client)
 
 	client->mapped = true;
 	client->visible = true;
+	client_update_outputs(client);
+	client_damage_whole(client);
+}
+
+void client_unmap(struct jwc_client *client)
+{
+	transaction_remove_client(client);
+	client_damage_whole(client);
+	client->mapped = false;
+	client_update_outputs(client);
+
+	/* configures not drawn are lost */
+	client->configure_serial = 0;
+	client->resize_queued = false;
+	client_invalidate_geometry(client);
 }
 
 static void client_safe_remove(struct jwc_client *client)
 {
-	if (client_exist(client->server, client))
+	client_unindex_surface(client);
+
+	grid_remove(client->server->client_grid, &client->grid_item);
+
+	if (client->in_list) {
 		wl_list_remove(&client->link);
-	else
+		client->in_list = false;
+		client->server->clients_stack_dirty = true;
+	} else {
 		INFO("Client not found");
+	}
 }
 
 void client_center_on_cursor(struct jwc_client *client)
@@ -112,17 +452,27 @@ void client_center_on_cursor(struct jwc_client *client)
 void client_destroy_event(struct wl_listener *listener, void *data)
 {
 	struct jwc_client *client = wl_container_of(listener, client, destroy);
+	if (client == client->server->drag_client)
+		output_set_drag_client(client->server, NULL);
+	transaction_remove_client(client);
 	wl_list_remove(&client->map.link);
 	wl_list_remove(&client->unmap.link);
 	wl_list_remove(&client->destroy.link);
 	wl_list_remove(&client->surface_commit.link);
 	client_safe_remove(client);
+	output_set_clients_dirty(client->server, client->output_mask);
+	pixman_region32_fini(&client->render_region);
+	free(client->saved_buffers);
 	free(client);
 }
 
 void client_init(struct jwc_server *server)
 {
 	wl_list_init(&server->clients);
+	for (int i = 0; i < CLIENT_SURFACE_BUCKETS; i++)
+		wl_list_init(&server->client_surfaces[i]);
+	server->client_grid = grid_create();
+	assert(server->client_grid);
 
 	/* init all client type */
 	xdg_shell_v6_init(server);
@@ -132,12 +482,10 @@ void client_init(struct jwc_server *server)
 static struct jwc_client *client_get_from_surface(struct jwc_server *server,
 						  struct wlr_surface *surface)
 {
-	struct wl_list *clients = &server->clients;
-	if (wl_list_empty(clients))
-		return NULL;
-
+	struct wl_list *bucket = client_get_surface_bucket(server, surface);
 	struct jwc_client *client;
-	wl_list_for_each(client, clients, link) {
+
+	wl_list_for_each(client, bucket, surface_link) {
 		if (client->surface == surface)
 			return client;
 	}
@@ -151,7 +499,7 @@ void client_set_focus(struct jwc_client *client)
 	struct wlr_seat *seat = client->server->seat;
 
 	/* check if the client can have focus */
-	if (client->is_focusable && !client->is_focusable(client))
+	if (client->ops->is_focusable && !client->ops->is_focusable(client))
 		return;
 
 	/* already focused */
@@ -164,11 +512,11 @@ void client_set_focus(struct jwc_client *client)
 		struct jwc_client *prev_client;
 		prev_client = client_get_from_surface(client->server, prev_surface);
 		if (prev_client)
-			prev_client->set_activated(prev_client, false);
+			prev_client->ops->set_activated(prev_client, false);
 	}
 
 	/* set activated the current focus */
-	client->set_activated(client, true);
+	client->ops->set_activated(client, true);
 
 	/* notify keyboard enter */
 	keyboard_enter(client->server, surface);
@@ -177,7 +525,7 @@ void client_set_focus(struct jwc_client *client)
 struct wlr_surface *client_surface_at(struct jwc_client *client, double sx, double sy,
 				      double *sub_x, double *sub_y)
 {
-	return client->surface_at(client, sx, sy, sub_x, sub_y);
+	return client->ops->surface_at(client, sx, sy, sub_x, sub_y);
 }
 
 struct jwc_client *client_get_on_toplevel(struct jwc_server *server)
@@ -196,6 +544,9 @@ void client_set_on_toplevel(struct jwc_client *client)
 	/* put this client on top of the list */
 	wl_list_remove(&client->link);
 	wl_list_insert(&client->server->clients, &client->link);
+	client->server->clients_stack_dirty = true;
+	output_set_clients_dirty(client->server, client->output_mask);
+	client_damage_whole(client);
 }
 
 struct jwc_client *client_get_last(struct jwc_server *server)
@@ -216,56 +567,98 @@ struct jwc_client *client_get_last(struct jwc_server *server)
 
 void client_set_invisible(struct jwc_client *client)
 {
+	client_damage_whole(client);
 	client->visible = false;
+	client_update_outputs(client);
 
 	struct jwc_client *last = client_get_last(client->server);
 	if (last) {
 		wl_list_remove(&client->link);
 		wl_list_insert(&last->link, &client->link);
+		client->server->clients_stack_dirty = true;
 	}
 }
 
 void client_get_geometry(struct jwc_client *client, struct wlr_box *box)
 {
-	client->get_geometry(client, box);
+	struct jwc_server *server = client->server;
+
+	if (client->geometry_valid) {
+		server->client_cache.hits++;
+		*box = client->geometry;
+		return;
+	}
+
+	server->client_cache.misses++;
+	client->ops->get_geometry(client, &client->geometry);
+	client->geometry_valid = true;
+	*box = client->geometry;
+}
+
+void client_invalidate_geometry(struct jwc_client *client)
+{
+	client->geometry_valid = false;
 }
 
 struct jwc_client *client_get_focus(struct jwc_server *server)
 {
-	double cursor_x = server->cursor->x;
-	double cursor_y = server->cursor->y;
+	struct jwc_client *focus;
+	struct jwc_grid_item *item;
 
-	/* check if we have clients */
-	struct wl_list *clients = &server->clients;
-	if (wl_list_empty(clients))
+	/* the stacking order is only computed again after a restack */
+	if (server->clients_stack_dirty)
+		client_update_stack(server);
+
+	/* only the clients overlapping the cursor cell are candidates */
+	item = grid_item_at(server->client_grid, server->cursor->x, server->cursor->y);
+	if (!item)
 		return NULL;
 
-	/* loop through clients */
+	return wl_container_of(item, focus, grid_item);
+}
+
+void client_flush_configures(struct jwc_server *server)
+{
+	xwayland_flush_configures(server);
+}
+
+void client_print_stats(struct jwc_server *server)
+{
 	struct jwc_client *client;
-	struct wlr_box box;
-	wl_list_for_each(client, clients, link) {
+	const char *title;
 
-		if (!client->mapped || !client->visible)
+	wl_list_for_each(client, &server->clients, link) {
+		if (client->configure_hist.count == 0)
 			continue;
 
-		/* intersect */
-		client_get_geometry(client, &box);
-		if ((cursor_x > box.x) && (cursor_y > box.y) &&
-		    (cursor_x < box.x + box.width) &&
-		    (cursor_y < box.y + box.height))
-			return client;
+		title = client->ops->get_title(client);
+		INFO("Client %s:", title ? title : "(no title)");
+		stats_log_print(&client->configure_hist, "configure");
 	}
 
-	return NULL;
+	INFO("Geometry caches:");
+	stats_print_cache(&server->client_cache, "client");
+}
+
+void client_set_alpha(struct jwc_client *client, float alpha)
+{
+	if (client->alpha == alpha)
+		return;
+
+	client->alpha = alpha;
+	output_update_client(client);
+	client_damage_whole(client);
 }
 
 void client_close(struct jwc_client *client)
 {
-	client->close(client);
+	client->ops->close(client);
 }
 
 void client_set_maximazed(struct jwc_client *client, bool maximized)
 {
+	transaction_begin(client->server);
+
 	if (maximized == true) {
 		/* save current coordinates */
 		client_get_geometry(client, &client->orig);
@@ -283,12 +676,16 @@ void client_set_maximazed(struct jwc_client *client, bool maximized)
 				   client->orig.width, client->orig.height);
 	}
 
-	client->set_maximized(client, maximized);
+	client->ops->set_maximized(client, maximized);
 	client->maximized = maximized;
+
+	transaction_commit(client->server);
 }
 
 void client_set_fullscreen(struct jwc_client *client, bool fullscreen)
 {
+	transaction_begin(client->server);
+
 	if (fullscreen == true) {
 		/* save current coordinates */
 		client_get_geometry(client, &client->orig);
@@ -307,8 +704,11 @@ void client_set_fullscreen(struct jwc_client *client, bool fullscreen)
 				   client->orig.width, client->orig.height);
 	}
 
-	client->set_fullscreen(client, fullscreen);
+	client->ops->set_fullscreen(client, fullscreen);
 	client->fullscreen = fullscreen;
+	output_update_client(client);
+
+	transaction_commit(client->server);
 }
 
 void client_move(struct jwc_client *client, double x, double y)
@@ -328,7 +728,12 @@ void client_move(struct jwc_client *client, double x, double y)
 	if ((y + box.height) > (layout->y + layout->height))
 		y = layout->y + layout->height - box.height;
 
-	client->move(client, x, y);
+	/* damage old and new position */
+	client_damage_whole(client);
+	client->ops->move(client, x, y);
+	client_invalidate_geometry(client);
+	client_update_outputs(client);
+	client_damage_whole(client);
 }
 
 void client_resize(struct jwc_client *client, double width, double height)
@@ -344,7 +749,8 @@ void client_resize(struct jwc_client *client, double width, double height)
 	if ((box.y + height) > (layout->y + layout->height))
 		height = layout->y + layout->height - box.y;
 
-	client->resize(client, width, height);
+	client->ops->resize(client, width, height);
+	client_invalidate_geometry(client);
 }
 
 void client_move_resize(struct jwc_client *client, double x, double y,
@@ -363,33 +769,223 @@ void client_move_resize(struct jwc_client *client, double x, double y,
 	if ((y + height) > (layout->y + layout->height))
 		height = layout->y + layout->height + height - y;
 
-	client->move_resize(client, x, y, width, height);
+	struct wlr_box box;
+	client_get_geometry(client, &box);
+
+	/* keep displaying the client as it is until it has been resized */
+	transaction_add_client(client);
+
+	client_damage_whole(client);
+	client->ops->move_resize(client, x, y, width, height);
+	client_invalidate_geometry(client);
+	client_update_outputs(client);
+	client_damage_whole(client);
+
+	/* a move is displayed right away, a resize waits for the client */
+	if (client->configure_serial > 0 &&
+	    (box.width != (int)width || box.height != (int)height))
+		transaction_wait_client(client);
 }
 
-void client_render_all(struct jwc_server *server, struct wlr_output *output,
-		       struct timespec *when)
+void client_occlude_all(struct jwc_output *output, pixman_region32_t *region)
 {
-	struct wl_list *clients = &server->clients;
-	if (wl_list_empty(clients))
+	struct jwc_server *server = output->server;
+	struct jwc_render_entry *clients;
+	int len;
+
+	clients = output_get_clients(output, &len);
+	if (len == 0)
 		return;
 
-	/* render all clients expect toplevel */
-	struct jwc_client *client;
+	/* output coordinates of the layout origin */
+	struct occlusion_data odata = {
+		.region = region,
+	};
+	wlr_output_layout_output_coords(server->output_layout, output->wlr_output,
+					&odata.ox, &odata.oy);
+
+	/* from the toplevel client to the bottom one: each client only has to
+	 * repaint what is not yet covered by an opaque client above it.
+	 */
+	for (int i = 0; i < len; i++) {
+		struct jwc_render_entry *entry = &clients[i];
+		struct jwc_client *client = entry->client;
+
+		/* client not damaged, i.e. only the cursor has moved */
+		pixman_box32_t extents = {
+			.x1 = entry->extents.x + odata.ox,
+			.y1 = entry->extents.y + odata.oy,
+			.x2 = entry->extents.x + entry->extents.width + odata.ox,
+			.y2 = entry->extents.y + entry->extents.height + odata.oy,
+		};
+		entry->damaged = pixman_region32_contains_rectangle(region, &extents) !=
+				 PIXMAN_REGION_OUT;
+		if (!entry->damaged)
+			continue;
+
+		pixman_region32_copy(&client->render_region, region);
+
+		/* translucent client doesn't hide anything, neither does a
+		 * client held by a transaction: the opaque region of its
+		 * surfaces may not match the saved buffers anymore.
+		 */
+		if (entry->alpha < 1 || client->in_transaction)
+			continue;
+
+		odata.client = client;
+		client->ops->for_each_surface(client, occlude_surface, &odata);
+	}
+}
+
+void client_render_all(struct jwc_output *output)
+{
+	struct jwc_server *server = output->server;
+	struct jwc_render_entry *clients;
+	int len;
+
+	clients = output_get_clients(output, &len);
+	if (len == 0)
+		return;
+
+	/* output coordinates of the layout origin, same for all surfaces */
 	struct render_data rdata = {
-		.output = output,
+		.output = output->wlr_output,
 		.renderer = server->renderer,
-		.when = when,
 	};
+	wlr_output_layout_output_coords(server->output_layout, output->wlr_output,
+					&rdata.ox, &rdata.oy);
 
-	wl_list_for_each_reverse(client, clients, link) {
+	/* render from the bottom client to the toplevel one */
+	for (int i = len - 1; i >= 0; i--) {
+		struct jwc_client *client = clients[i].client;
+
+		/* client not damaged, its render region is outdated */
+		if (!clients[i].damaged)
+			continue;
 
-		/* if client is not mapped, no need to render it */
-		if (!client->mapped || !client->visible)
+		/* client fully covered */
+		if (!pixman_region32_not_empty(&client->render_region))
 			continue;
 
 		/* update surface of the client */
 		rdata.client = client;
-		client->for_each_surface(client, render_surface, &rdata);
+		if (client->in_transaction)
+			render_saved_buffers(&rdata);
+		else
+			client->ops->for_each_surface(client, render_surface, &rdata);
+	}
+}
+
+void client_render(struct jwc_output *output, struct jwc_client *client)
+{
+	struct jwc_server *server = output->server;
+	struct render_data rdata = {
+		.output = output->wlr_output,
+		.renderer = server->renderer,
+		.client = client,
+	};
+
+	if (!pixman_region32_not_empty(&client->render_region))
+		return;
+
+	wlr_output_layout_output_coords(server->output_layout, output->wlr_output,
+					&rdata.ox, &rdata.oy);
+	if (client->in_transaction)
+		render_saved_buffers(&rdata);
+	else
+		client->ops->for_each_surface(client, render_surface, &rdata);
+}
+
+struct wlr_surface *client_get_scanout_surface(struct jwc_output *output)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct jwc_render_entry *clients;
+	int len;
+
+	/* get the toplevel client displayed on this output */
+	clients = output_get_clients(output, &len);
+	if (len == 0)
+		return NULL;
+
+	/* only an opaque fullscreen client can be displayed as is */
+	struct jwc_client *client = clients[0].client;
+	if (!clients[0].fullscreen || clients[0].alpha < 1)
+		return NULL;
+
+	/* its new buffer is not displayed until the transaction is released */
+	if (client->in_transaction)
+		return NULL;
+
+	/* popups or subsurfaces need composition */
+	int count = 0;
+	client->ops->for_each_surface(client, count_surface, &count);
+	if (count != 1)
+		return NULL;
+
+	/* the surface buffer must match exactly the output */
+	struct wlr_surface *surface = client->surface;
+	if (!wlr_surface_has_buffer(surface) ||
+	    surface->current.transform != wlr_output->transform ||
+	    surface->current.scale != wlr_output->scale ||
+	    surface->current.buffer_width != wlr_output->width ||
+	    surface->current.buffer_height != wlr_output->height)
+		return NULL;
+
+	/* the plane ignores alpha, transparent areas would show what is below */
+	pixman_box32_t whole = {
+		.x1 = 0,
+		.y1 = 0,
+		.x2 = surface->current.width,
+		.y2 = surface->current.height,
+	};
+	if (pixman_region32_contains_rectangle(&surface->opaque_region, &whole) !=
+	    PIXMAN_REGION_IN)
+		return NULL;
+
+	double ox = 0, oy = 0;
+	wlr_output_layout_output_coords(output->server->output_layout, wlr_output,
+					&ox, &oy);
+	if (client->x + ox != 0 || client->y + oy != 0)
+		return NULL;
+
+	return surface;
+}
+
+void client_send_frame_done_all(struct jwc_output *output, struct timespec *when)
+{
+	struct jwc_render_entry *clients;
+	int len;
+
+	clients = output_get_clients(output, &len);
+	for (int i = 0; i < len; i++) {
+		struct jwc_client *client = clients[i].client;
+
+		/* this client is paced by another output */
+		if (!clients[i].primary)
+			continue;
+
+		client->ops->for_each_surface(client, frame_done_surface, when);
+	}
+}
+
+void client_send_presented_all(struct jwc_output *output,
+			       struct wlr_presentation_event *event)
+{
+	struct presentation_data pdata = {
+		.presentation = output->server->presentation,
+		.event = event,
+	};
+	struct jwc_render_entry *clients;
+	int len;
+
+	clients = output_get_clients(output, &len);
+	for (int i = 0; i < len; i++) {
+		struct jwc_client *client = clients[i].client;
+
+		if (!clients[i].primary)
+			continue;
+
+		client->ops->for_each_surface(client, presented_surface, &pdata);
 	}
 }
 
@@ -405,11 +1001,17 @@ void client_update_all(struct jwc_server *server)
 
 	wl_list_for_each(client, clients, link) {
 
+		/* unmapped clients are placed again when they are mapped */
+		if (!client->mapped)
+			continue;
+
 		client_get_geometry(client, &box);
 
 		output = output_get_output_at(server, box.x, box.y);
 
 		if (output == NULL)
 			client_move(client, 0, 0);
+
+		client_update_outputs(client);
 	}
 }
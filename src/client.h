@@ -21,22 +21,19 @@
 #define CLIENT_H
 
 #include "server.h"
+#include "grid.h"
+#include "output.h"
 
-struct jwc_client {
-	/* pointer to compositor server */
-	struct jwc_server *server;
-
-	/* index in clients list */
-	struct wl_list link;
+struct jwc_client;
 
-	/* surface ressources */
-	struct wlr_surface *surface;
-	union {
-		struct wlr_xdg_surface_v6 *xdg_surface_v6;
-		struct wlr_xwayland_surface *xwayland_surface;
-	};
+/* buffer of a surface kept while its client is held by a transaction */
+struct jwc_saved_buffer {
+	struct wlr_client_buffer *buffer;
+	struct wlr_box box;
+};
 
-	/* surface features */
+/* features implemented by each shell */
+struct jwc_client_ops {
 	void (*close)(struct jwc_client *client);
 	void (*move)(struct jwc_client *client, double x, double y);
 	void (*resize)(struct jwc_client *client, double width, double height);
@@ -53,6 +50,35 @@ struct jwc_client {
 				 wlr_surface_iterator_func_t iterator,
 				 void *user_data);
 	bool (*is_focusable)(struct jwc_client *client);
+	const char *(*get_title)(struct jwc_client *client);
+};
+
+struct jwc_client {
+	/* pointer to compositor server */
+	struct jwc_server *server;
+
+	/* index in clients list */
+	struct wl_list link;
+	bool in_list;
+
+	/* index in the surface hash table, from the first map to the destroy */
+	struct wl_list surface_link;
+	bool indexed;
+
+	/* position in clients list (0 on toplevel) and geometry registered in
+	 * the clients grid while mapped and visible.
+	 */
+	struct jwc_grid_item grid_item;
+
+	/* surface ressources */
+	struct wlr_surface *surface;
+	union {
+		struct wlr_xdg_surface_v6 *xdg_surface_v6;
+		struct wlr_xwayland_surface *xwayland_surface;
+	};
+
+	/* surface features, shared by the clients of a shell */
+	const struct jwc_client_ops *ops;
 
 	/* Wayland listeners */
 	struct wl_listener map;
@@ -60,14 +86,67 @@ struct jwc_client {
 	struct wl_listener destroy;
 	struct wl_listener surface_commit;
 	struct wl_listener request_configure;
+	struct wl_listener ack_configure;
 
 	/* client ressources */
 	double x, y;
 	struct wlr_box orig;
 	struct wlr_box pending_geo;
 	uint32_t pending_serial;
+
+	/* geometry returned by the shell, until a commit, a configure ack
+	 * or a move/resize changes it.
+	 */
+	struct wlr_box geometry;
+	bool geometry_valid;
+
+	/* held by a transaction: the buffers and the outputs of the surfaces
+	 * when the transaction started are displayed until it is released.
+	 */
+	bool in_transaction, transaction_pending;
+	struct jwc_saved_buffer *saved_buffers;
+	int saved_len, saved_size;
+	struct wlr_box saved_extents;
+	uint32_t saved_mask;
+
+	/* last configure sent, until the client commits it, and the size
+	 * requested meanwhile: only one resize is sent at a time.
+	 */
+	uint32_t configure_serial;
+	int64_t configure_time;
+	bool resize_queued;
+	double resize_width, resize_height;
+	struct jwc_log_histogram configure_hist;
+
+	/* X11 window moved, the X server is told once per frame */
+	struct wl_list x11_configure_link;
+	bool x11_configure_queued;
+
+	/* X11 buffer size when the last resize was sent and commits since */
+	int x11_configure_width, x11_configure_height;
+	int x11_configure_commits;
+
 	bool mapped, maximized, fullscreen, visible;
 	float alpha;
+
+	/* outputs displaying this client (see jwc_output mask) and the one
+	 * displaying the biggest part of it.
+	 */
+	uint32_t output_mask;
+	struct jwc_output *output;
+
+	/* position of the entry of this client in the clients of each output,
+	 * indexed by the bit of the output mask.
+	 */
+	int output_entries[OUTPUT_MAX];
+
+	/* area covered by all the surfaces of the client (layout coordinates) */
+	struct wlr_box extents;
+
+	/* region to repaint on the output being rendered, outdated when the
+	 * client entry of this output is not damaged
+	 */
+	pixman_region32_t render_region;
 };
 
 /**
@@ -75,9 +154,47 @@ struct jwc_client {
  */
 void client_init(struct jwc_server *server);
 void client_setup(struct jwc_client *client);
+void client_unmap(struct jwc_client *client);
 void client_center_on_cursor(struct jwc_client *client);
 void client_destroy_event(struct wl_listener *listener, void *data);
 
+/**
+ * Damage the client area on the outputs, either entirely or only the part
+ * updated by the last surface commit.
+ */
+void client_damage_whole(struct jwc_client *client);
+void client_commit(struct jwc_client *client);
+
+/**
+ * Keep the current buffers of the client to display them while it is held
+ * by a transaction, or release them.
+ */
+void client_save_buffers(struct jwc_client *client);
+void client_drop_saved_buffers(struct jwc_client *client);
+
+/**
+ * Update the outputs displaying the client after it has been moved, resized,
+ * mapped or hidden.
+ */
+void client_update_outputs(struct jwc_client *client);
+
+/**
+ * Send the position of the moved X11 clients to the X server, done once
+ * per frame and at the end of a drag.
+ */
+void client_flush_configures(struct jwc_server *server);
+
+/**
+ * Print the configure to commit latency of the clients and the geometry
+ * cache counters in the log
+ */
+void client_print_stats(struct jwc_server *server);
+
+/**
+ * Change the transparency of the client
+ */
+void client_set_alpha(struct jwc_client *client, float alpha);
+
 /**
  * TODO
  */
@@ -107,9 +224,11 @@ struct jwc_client *client_get_last(struct jwc_server *server);
 void client_set_invisible(struct jwc_client *client);
 
 /**
- * TODO
+ * Get the geometry of the client (layout coordinates) from the cache,
+ * shells invalidate it when their surface state changes.
  */
 void client_get_geometry(struct jwc_client *client, struct wlr_box *box);
+void client_invalidate_geometry(struct jwc_client *client);
 
 /**
  * TODO
@@ -131,10 +250,40 @@ void client_move_resize(struct jwc_client *client, double x, double y,
 			double width, double height);
 
 /**
- * TODO
+ * Find which clients of output intersect the damaged region and subtract
+ * their opaque areas from it, from the toplevel client to the bottom one.
+ */
+void client_occlude_all(struct jwc_output *output, pixman_region32_t *region);
+
+/**
+ * Render the damaged part of the clients of output not hidden by an opaque
+ * client above them, or of a single client.
+ */
+void client_render_all(struct jwc_output *output);
+void client_render(struct jwc_output *output, struct jwc_client *client);
+
+/**
+ * Get the surface of the fullscreen client covering entirely output if its
+ * buffer can be directly scanned out.
+ */
+struct wlr_surface *client_get_scanout_surface(struct jwc_output *output);
+
+/**
+ * Send frame done events to the clients paced by output
+ */
+void client_send_frame_done_all(struct jwc_output *output, struct timespec *when);
+
+/**
+ * Send presentation feedback to the clients paced by output once the
+ * content sampled during the last frame has been displayed.
+ */
+void client_send_presented_all(struct jwc_output *output,
+			       struct wlr_presentation_event *event);
+
+/**
+ * Move back into the layout the clients left outside of it, after outputs
+ * have been removed or moved.
  */
-void client_render_all(struct jwc_server *server, struct wlr_output *output,
-		       struct timespec *when);
 void client_update_all(struct jwc_server *server);
 
 #endif
@@ -21,6 +21,7 @@
 #include "bindings.h"
 #include "client.h"
 #include "output.h"
+#include "utils.h"
 
 static void cursor_motion_handle(struct jwc_server *server, double x, double y, uint32_t time)
 {
@@ -34,8 +35,6 @@ static void cursor_motion_handle(struct jwc_server *server, double x, double y,
 	 */
 	if (handle == false) {
 
-		cursor_set_image(server, "left_ptr");
-
 		struct jwc_client *focus = client_get_focus(server);
 		if (focus != NULL) {
 			/* surface-local coordinates */
@@ -45,12 +44,54 @@ static void cursor_motion_handle(struct jwc_server *server, double x, double y,
 									y - focus->y,
 									&sx, &sy);
 
+			/* the client sets its own image once the pointer has
+			 * entered its surface, don't override it.
+			 */
+			if (surface != server->seat->pointer_state.focused_surface ||
+			    server->cursor_image)
+				cursor_set_image(server, "left_ptr");
+
 			wlr_seat_pointer_notify_enter(server->seat, surface, sx, sy);
 			wlr_seat_pointer_notify_motion(server->seat, time, sx, sy);
 			client_set_focus(focus);
-		} else
+		} else {
+			cursor_set_image(server, "left_ptr");
 			wlr_seat_pointer_clear_focus(server->seat);
+		}
+	}
+}
+
+static void cursor_idle_event(void *data)
+{
+	struct jwc_server *server = data;
+
+	/* idle sources are removed once dispatched */
+	server->cursor_idle = NULL;
+	cursor_flush(server);
+}
+
+static void cursor_schedule_flush(struct jwc_server *server)
+{
+	if (!server->cursor_coalesce) {
+		cursor_flush(server);
+		return;
 	}
+
+	if (!server->cursor_idle)
+		server->cursor_idle = wl_event_loop_add_idle(server->wl_event_loop,
+							     cursor_idle_event, server);
+}
+
+static void cursor_queue_motion(struct jwc_server *server, double x, double y, uint32_t time)
+{
+	/* only the last position matters */
+	server->cursor_motion_x = x;
+	server->cursor_motion_y = y;
+	server->cursor_motion_time = time;
+	server->cursor_motion_pending = true;
+	server->motion_events++;
+
+	cursor_schedule_flush(server);
 }
 
 static void cursor_motion_event(struct wl_listener *listener, void *data)
@@ -67,7 +108,7 @@ static void cursor_motion_event(struct wl_listener *listener, void *data)
 	x = !isnan(event->delta_x) ? cursor->x + event->delta_x : cursor->x;
 	y = !isnan(event->delta_y) ? cursor->y + event->delta_y : cursor->y;
 
-	cursor_motion_handle(server, x, y, event->time_msec);
+	cursor_queue_motion(server, x, y, event->time_msec);
 }
 
 static void cursor_motion_absolute_event(struct wl_listener *listener, void *data)
@@ -82,7 +123,7 @@ static void cursor_motion_absolute_event(struct wl_listener *listener, void *dat
 
 	cursor_move(server, x, y);
 
-	cursor_motion_handle(server, x, y, event->time_msec);
+	cursor_queue_motion(server, x, y, event->time_msec);
 }
 
 static void cursor_button_event(struct wl_listener *listener, void *data)
@@ -91,8 +132,12 @@ static void cursor_button_event(struct wl_listener *listener, void *data)
 	struct wlr_event_pointer_button *event = data;
 	bool handle;
 
+	/* the button applies where the pointer is now */
+	cursor_flush(server);
+
 	server->cursor_button_left_pressed = false;
 	server->cursor_button_right_pressed = false;
+	server->cursor_coalesce = true;
 	server->cursor_button_left_released = false;
 	server->cursor_button_right_released = false;
 
@@ -125,8 +170,26 @@ static void cursor_axis_event(struct wl_listener *listener, void *data)
 {
 	struct jwc_server *server = wl_container_of(listener, server, cursor_axis);
 	struct wlr_event_pointer_axis *event = data;
-	wlr_seat_pointer_notify_axis(server->seat, event->time_msec, event->orientation,
-				     event->delta, event->delta_discrete, event->source);
+	struct jwc_cursor_axis *axis = &server->cursor_axis_pending[event->orientation];
+
+	/* a scroll stop (no delta, i.e. finger lifted) would vanish in the sum:
+	 * what is pending goes first, then the stop in its own pointer frame.
+	 * Scroll from another device type can't be merged either.
+	 */
+	bool stop = event->delta == 0;
+	if (stop || (axis->pending && axis->source != event->source))
+		cursor_flush(server);
+
+	axis->delta += event->delta;
+	axis->delta_discrete += event->delta_discrete;
+	axis->source = event->source;
+	axis->time = event->time_msec;
+	axis->pending = true;
+
+	if (stop)
+		cursor_flush(server);
+	else
+		cursor_schedule_flush(server);
 }
 
 static void cursor_request_set_cursor_event(struct wl_listener *listener, void *data)
@@ -139,9 +202,11 @@ static void cursor_request_set_cursor_event(struct wl_listener *listener, void *
 	/* check if this event match with the focus surface */
 	struct jwc_client *focus = client_get_focus(server);
 	if (focus != NULL) {
-		if (focused_surface == focus->surface)
+		if (focused_surface == focus->surface) {
 			wlr_cursor_set_surface(server->cursor, event->surface,
 					       event->hotspot_x, event->hotspot_y);
+			server->cursor_image = NULL;
+		}
 	}
 }
 
@@ -196,7 +261,109 @@ void cursor_new(struct jwc_server *server, struct wlr_input_device *device)
 
 void cursor_set_image(struct jwc_server *server, const char *name)
 {
+	/* avoid looking up the theme and uploading the image on every motion */
+	if (server->cursor_image && !strcmp(server->cursor_image, name))
+		return;
+
 	wlr_xcursor_manager_set_cursor_image(server->cursor_mgr, name, server->cursor);
+	server->cursor_image = name;
+}
+
+void cursor_reset_image(struct jwc_server *server)
+{
+	const char *name = server->cursor_image;
+
+	/* nothing to do when a client surface is displayed */
+	if (!name)
+		return;
+
+	server->cursor_image = NULL;
+	cursor_set_image(server, name);
+}
+
+void cursor_load_scale(struct jwc_server *server, float scale)
+{
+	struct wlr_xcursor_manager_theme *theme;
+
+	if (!server->cursor_mgr)
+		return;
+
+	wl_list_for_each(theme, &server->cursor_mgr->scaled_themes, link) {
+		if (theme->scale == scale)
+			return;
+	}
+
+	if (!wlr_xcursor_manager_load(server->cursor_mgr, scale)) {
+		ERROR("Failed to load cursor theme at scale %.2f", scale);
+		return;
+	}
+	INFO("Cursor theme loaded at scale %.2f", scale);
+
+	/* the image displayed has now a version for this scale */
+	cursor_reset_image(server);
+}
+
+void cursor_flush(struct jwc_server *server)
+{
+	bool axis_pending = false;
+
+	if (server->cursor_idle) {
+		wl_event_source_remove(server->cursor_idle);
+		server->cursor_idle = NULL;
+	}
+
+	if (server->cursor_motion_pending) {
+		int64_t start = get_time_nsec();
+		server->cursor_motion_pending = false;
+		cursor_motion_handle(server, server->cursor_motion_x, server->cursor_motion_y,
+				     server->cursor_motion_time);
+		stats_add(&server->motion_hist, get_time_nsec() - start);
+		server->motion_handled++;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		struct jwc_cursor_axis *axis = &server->cursor_axis_pending[i];
+		if (!axis->pending)
+			continue;
+
+		wlr_seat_pointer_notify_axis(server->seat, axis->time, i, axis->delta,
+					     axis->delta_discrete, axis->source);
+		memset(axis, 0, sizeof(*axis));
+		axis_pending = true;
+	}
+
+	/* group the scroll of both axis in one pointer frame */
+	if (axis_pending)
+		wlr_seat_pointer_notify_frame(server->seat);
+}
+
+void cursor_set_coalesce(struct jwc_server *server, bool enabled)
+{
+	if (server->cursor_coalesce == enabled)
+		return;
+
+	/* process what has been queued so far */
+	if (server->cursor_idle) {
+		wl_event_source_remove(server->cursor_idle);
+		server->cursor_idle = NULL;
+	}
+	cursor_flush(server);
+
+	/* the stats only describe one mode */
+	server->cursor_coalesce = enabled;
+	server->motion_events = 0;
+	server->motion_handled = 0;
+	memset(&server->motion_hist, 0, sizeof(server->motion_hist));
+
+	INFO("Pointer events coalescing %s", enabled ? "enabled" : "disabled");
+}
+
+void cursor_print_stats(struct jwc_server *server)
+{
+	INFO("Pointer: %llu motion events, %llu processed",
+	     (unsigned long long)server->motion_events,
+	     (unsigned long long)server->motion_handled);
+	stats_print(&server->motion_hist, "motion");
 }
 
 void cursor_move(struct jwc_server *server, double x, double y)
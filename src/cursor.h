@@ -33,10 +33,37 @@ void cursor_init(struct jwc_server *server);
 void cursor_new(struct jwc_server *server, struct wlr_input_device *device);
 
 /**
- * TODO
+ * Set the xcursor image, nothing is done if it is already displayed
  */
 void cursor_set_image(struct jwc_server *server, const char *name);
 
+/**
+ * Set again the xcursor image, i.e. on the outputs added to the layout
+ */
+void cursor_reset_image(struct jwc_server *server);
+
+/**
+ * Load the xcursor theme for an output scale if not done yet
+ */
+void cursor_load_scale(struct jwc_server *server, float scale);
+
+/**
+ * Process the pointer motion and scroll once all the pending input events
+ * have been read (and right before rendering) instead of on every event of
+ * high rate mice. Enabled by default.
+ */
+void cursor_set_coalesce(struct jwc_server *server, bool enabled);
+
+/**
+ * Process the pointer motion and scroll accumulated so far
+ */
+void cursor_flush(struct jwc_server *server);
+
+/**
+ * Print the pointer motion received, processed and their cost in the log
+ */
+void cursor_print_stats(struct jwc_server *server);
+
 /**
  * TODO
  */
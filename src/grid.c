@@ -0,0 +1,196 @@
+/*
+ * This file is part of the jwm distribution:
+ * https://github.com/JulienMasson/jwc
+ *
+ * Copyright (c) 2019 Julien Masson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "grid.h"
+
+/* floor division, layout coordinates can be negative */
+static int grid_coord(int v)
+{
+	return v >= 0 ? v / GRID_CELL_SIZE : -((-v + GRID_CELL_SIZE - 1) / GRID_CELL_SIZE);
+}
+
+static struct jwc_grid_cell *grid_get_cell(struct jwc_grid *grid, int cx, int cy)
+{
+	cx = ((cx % GRID_SIZE) + GRID_SIZE) % GRID_SIZE;
+	cy = ((cy % GRID_SIZE) + GRID_SIZE) % GRID_SIZE;
+
+	return &grid->cells[cy * GRID_SIZE + cx];
+}
+
+static int grid_cell_compare(const void *a, const void *b)
+{
+	const struct jwc_grid_item *item_a = *(struct jwc_grid_item * const *)a;
+	const struct jwc_grid_item *item_b = *(struct jwc_grid_item * const *)b;
+
+	return item_a->stack_index - item_b->stack_index;
+}
+
+static void grid_cell_sort(struct jwc_grid *grid, struct jwc_grid_cell *cell)
+{
+	if (cell->generation == grid->generation)
+		return;
+
+	qsort(cell->items, cell->len, sizeof(*cell->items), grid_cell_compare);
+	cell->generation = grid->generation;
+}
+
+static bool grid_cell_add(struct jwc_grid *grid, struct jwc_grid_cell *cell,
+			  struct jwc_grid_item *item)
+{
+	int pos = cell->len;
+
+	if (cell->len == cell->size) {
+		int size = cell->size ? cell->size * 2 : 4;
+		struct jwc_grid_item **items = realloc(cell->items, size * sizeof(*items));
+		if (!items)
+			return false;
+		cell->items = items;
+		cell->size = size;
+	}
+
+	/* keep a sorted cell sorted, the others are sorted on lookup */
+	if (cell->generation == grid->generation) {
+		int low = 0, high = cell->len;
+		while (low < high) {
+			int mid = (low + high) / 2;
+			if (cell->items[mid]->stack_index < item->stack_index)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		pos = low;
+		memmove(&cell->items[pos + 1], &cell->items[pos],
+			(cell->len - pos) * sizeof(*cell->items));
+	}
+
+	cell->items[pos] = item;
+	cell->len++;
+	return true;
+}
+
+static bool grid_cell_del(struct jwc_grid *grid, struct jwc_grid_cell *cell,
+			  struct jwc_grid_item *item)
+{
+	for (int i = 0; i < cell->len; i++) {
+		if (cell->items[i] == item) {
+			cell->len--;
+			memmove(&cell->items[i], &cell->items[i + 1],
+				(cell->len - i) * sizeof(*cell->items));
+			break;
+		}
+	}
+
+	return true;
+}
+
+/* every bucket covered by the box is only visited once */
+static bool grid_for_each_cell(struct jwc_grid *grid, struct jwc_grid_item *item,
+			       bool (*func)(struct jwc_grid *grid,
+					    struct jwc_grid_cell *cell,
+					    struct jwc_grid_item *item))
+{
+	struct wlr_box *box = &item->box;
+	int x1 = grid_coord(box->x);
+	int y1 = grid_coord(box->y);
+	int x2 = grid_coord(box->x + box->width - 1);
+	int y2 = grid_coord(box->y + box->height - 1);
+	bool success = true;
+
+	if (x2 > x1 + GRID_SIZE - 1)
+		x2 = x1 + GRID_SIZE - 1;
+	if (y2 > y1 + GRID_SIZE - 1)
+		y2 = y1 + GRID_SIZE - 1;
+
+	for (int cy = y1; cy <= y2; cy++)
+		for (int cx = x1; cx <= x2; cx++)
+			success &= func(grid, grid_get_cell(grid, cx, cy), item);
+
+	return success;
+}
+
+struct jwc_grid *grid_create(void)
+{
+	return calloc(1, sizeof(struct jwc_grid));
+}
+
+void grid_destroy(struct jwc_grid *grid)
+{
+	for (int i = 0; i < GRID_SIZE * GRID_SIZE; i++)
+		free(grid->cells[i].items);
+	free(grid);
+}
+
+void grid_remove(struct jwc_grid *grid, struct jwc_grid_item *item)
+{
+	if (!item->in_grid)
+		return;
+
+	grid_for_each_cell(grid, item, grid_cell_del);
+	item->in_grid = false;
+}
+
+bool grid_update(struct jwc_grid *grid, struct jwc_grid_item *item, struct wlr_box *box)
+{
+	if (item->in_grid) {
+		if (!memcmp(box, &item->box, sizeof(*box)))
+			return true;
+
+		grid_remove(grid, item);
+	}
+
+	if (box->width <= 0 || box->height <= 0)
+		return true;
+
+	/* registered even if partially: the next removal cleans it up */
+	item->box = *box;
+	item->in_grid = true;
+	return grid_for_each_cell(grid, item, grid_cell_add);
+}
+
+void grid_restack(struct jwc_grid *grid)
+{
+	grid->generation++;
+}
+
+struct jwc_grid_item *grid_item_at(struct jwc_grid *grid, double x, double y)
+{
+	struct jwc_grid_cell *cell;
+
+	int ix = (int)x - (x < (int)x);
+	int iy = (int)y - (y < (int)y);
+	cell = grid_get_cell(grid, grid_coord(ix), grid_coord(iy));
+	grid_cell_sort(grid, cell);
+
+	/* the first item found is the topmost one */
+	for (int i = 0; i < cell->len; i++) {
+		struct jwc_grid_item *item = cell->items[i];
+		struct wlr_box *box = &item->box;
+
+		/* intersect */
+		if ((x > box->x) && (y > box->y) &&
+		    (x < box->x + box->width) &&
+		    (y < box->y + box->height))
+			return item;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,78 @@
+/*
+ * This file is part of the jwm distribution:
+ * https://github.com/JulienMasson/jwc
+ *
+ * Copyright (c) 2019 Julien Masson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdbool.h>
+#include <wlr/types/wlr_box.h>
+
+/* spatial hash of boxes in layout coordinates: cells of GRID_CELL_SIZE pixels
+ * wrapped on GRID_SIZE x GRID_SIZE buckets, so negative or large layouts
+ * need no resize.
+ */
+#define GRID_CELL_SIZE	256
+#define GRID_SIZE	32
+
+/* embedded in the object registered, the lowest stack index is on top */
+struct jwc_grid_item {
+	struct wlr_box box;
+	int stack_index;
+	bool in_grid;
+};
+
+/* items of a cell are kept from the top to the bottom, a cell is sorted
+ * again on lookup after a restack.
+ */
+struct jwc_grid_cell {
+	struct jwc_grid_item **items;
+	int len, size;
+	unsigned int generation;
+};
+
+struct jwc_grid {
+	struct jwc_grid_cell cells[GRID_SIZE * GRID_SIZE];
+	unsigned int generation;
+};
+
+/**
+ * Allocate an empty grid, NULL on failure
+ */
+struct jwc_grid *grid_create(void);
+void grid_destroy(struct jwc_grid *grid);
+
+/**
+ * Register the item at box, only the cells of the previous box are updated
+ * when it has changed. Returns false if a cell could not be grown.
+ */
+bool grid_update(struct jwc_grid *grid, struct jwc_grid_item *item, struct wlr_box *box);
+void grid_remove(struct jwc_grid *grid, struct jwc_grid_item *item);
+
+/**
+ * The stack indexes of the items have changed
+ */
+void grid_restack(struct jwc_grid *grid);
+
+/**
+ * Get the topmost item containing the point, only the items overlapping
+ * its cell are checked.
+ */
+struct jwc_grid_item *grid_item_at(struct jwc_grid *grid, double x, double y);
+
+#endif
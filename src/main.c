@@ -23,6 +23,7 @@
 #include "cursor.h"
 #include "keyboard.h"
 #include "client.h"
+#include "transaction.h"
 
 static void redirect_stdio(void)
 {
@@ -61,11 +62,15 @@ static void wlroots_init(struct jwc_server *server)
 
 	/* allocate new seat and add global to the display*/
 	server->seat = wlr_seat_create(server->wl_display, "seat0");
+
+	/* create presentation time global to report when frames are displayed */
+	server->presentation = wlr_presentation_create(server->wl_display,
+						       server->backend);
 }
 
 int main(void)
 {
-	struct jwc_server server;
+	struct jwc_server server = {0};
 
 	/* init logging */
 	redirect_stdio();
@@ -84,6 +89,7 @@ int main(void)
 	input_init(&server);
 	cursor_init(&server);
 	keyboard_init(&server);
+	transaction_init(&server);
 	client_init(&server);
 
 	/* open wayland socket */
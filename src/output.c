@@ -17,84 +17,653 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <signal.h>
+
 #include "output.h"
 #include "client.h"
+#include "cursor.h"
+#include "transaction.h"
 #include "utils.h"
 
-struct jwc_output {
-	/* pointer to compositor server */
-	struct jwc_server *server;
+struct output_config {
+	const char *name;
+	int max_render_time;
+	int render_margin;
+	enum output_adaptive_sync adaptive_sync;
+	bool low_latency;
+};
 
-	/* index in outputs list */
-	struct wl_list link;
+/* render deadline, variable refresh rate and low latency mode of each output,
+ * the first entry is the default one
+ */
+static const struct output_config output_configs[] = {
+	{ NULL, OUTPUT_MAX_RENDER_TIME_ADAPTIVE, 1, OUTPUT_ADAPTIVE_SYNC_FULLSCREEN, false },
+	{ DEFAULT_PRIMARY_OUTPUT, OUTPUT_MAX_RENDER_TIME_ADAPTIVE, 1,
+	  OUTPUT_ADAPTIVE_SYNC_FULLSCREEN, false },
+};
 
-	/* Wayland listeners */
-	struct wl_listener frame;
-	struct wl_listener destroy;
+static const struct output_config *output_get_config(const char *name)
+{
+	size_t count = sizeof(output_configs) / sizeof(output_configs[0]);
 
-	/* output ressources */
-	struct wlr_output *wlr_output;
-	bool enabled;
-};
+	for (size_t i = 1; i < count; i++) {
+		if (!strcmp(output_configs[i].name, name))
+			return &output_configs[i];
+	}
+
+	return &output_configs[0];
+}
+
+void output_scissor(struct wlr_output *wlr_output, pixman_box32_t *rect)
+{
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(wlr_output->backend);
+	struct wlr_box box = {
+		.x = rect->x1,
+		.y = rect->y1,
+		.width = rect->x2 - rect->x1,
+		.height = rect->y2 - rect->y1,
+	};
+
+	/* damage is in output coordinates, scissor works on the buffer */
+	int width, height;
+	wlr_output_transformed_resolution(wlr_output, &width, &height);
+	enum wl_output_transform transform = wlr_output_transform_invert(wlr_output->transform);
+	wlr_box_transform(&box, &box, transform, width, height);
+
+	wlr_renderer_scissor(renderer, &box);
+}
+
+static bool output_scanout(struct jwc_output *output)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_surface *surface;
+	int64_t commit_start;
+
+	surface = client_get_scanout_surface(output);
+	if (!surface)
+		return false;
+
+	/* the client buffer is already displayed and didn't change */
+	if (output->scanout && !pixman_region32_not_empty(&output->damage->current))
+		return true;
+
+	/* attach the client buffer and check that the backend can display it
+	 * (i.e. no software cursor, plane/format supported)
+	 */
+	commit_start = get_time_nsec();
+	if (!wlr_output_attach_buffer(wlr_output, &surface->buffer->base))
+		return false;
+
+	if (!wlr_output_test(wlr_output)) {
+		wlr_output_rollback(wlr_output);
+		return false;
+	}
+
+	if (!wlr_output_commit(wlr_output))
+		return false;
+
+	wlr_presentation_surface_sampled(output->server->presentation, surface);
+	output->commit_time = get_time_nsec();
+
+	/* nothing composited, the frame only costs the commit */
+	stats_add(&output->render_hist, 0);
+	stats_add(&output->commit_hist, output->commit_time - commit_start);
+	return true;
+}
 
-static void output_render(struct jwc_server *server, struct wlr_output *wlr_output)
+static struct jwc_client *output_get_drag_client(struct jwc_output *output)
 {
+	struct jwc_client *client = output->server->drag_client;
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct jwc_render_entry *clients;
+	int len;
+
+	if (!client || output->drag_cache_disabled)
+		return NULL;
+
+	/* the cache is drawn as is in the output buffer */
+	if (wlr_output->transform != WL_OUTPUT_TRANSFORM_NORMAL || wlr_output->scale != 1)
+		return NULL;
+
+	/* only a translucent client on top of the others can be drawn over it */
+	clients = output_get_clients(output, &len);
+	if (len == 0 || clients[0].client != client || clients[0].alpha == 1)
+		return NULL;
+
+	return client;
+}
+
+static void output_update_drag_cache(struct jwc_output *output)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_renderer *renderer = output->server->renderer;
+	uint32_t width = wlr_output->width;
+	uint32_t height = wlr_output->height;
+	uint32_t stride = width * 4;
+	uint32_t flags = 0;
+
+	uint8_t *data = malloc(stride * height);
+	if (!data) {
+		output->drag_cache_disabled = true;
+		return;
+	}
+
+	/* read back what has been composited so far */
+	wlr_renderer_scissor(renderer, NULL);
+	if (!wlr_renderer_read_pixels(renderer, WL_SHM_FORMAT_ARGB8888, &flags, stride,
+				      width, height, 0, 0, 0, 0, data)) {
+		ERROR("Failed to read pixels of %s", wlr_output->name);
+		output->drag_cache_disabled = true;
+		free(data);
+		return;
+	}
+
+	if (flags & WLR_RENDERER_READ_PIXELS_Y_INVERT) {
+		uint8_t *row = malloc(stride);
+		for (uint32_t y = 0; row && y < height / 2; y++) {
+			memcpy(row, data + y * stride, stride);
+			memcpy(data + y * stride, data + (height - y - 1) * stride, stride);
+			memcpy(data + (height - y - 1) * stride, row, stride);
+		}
+		free(row);
+	}
+
+	/* background is opaque, no need to blend the cache */
+	output->drag_cache = wlr_texture_from_pixels(renderer, WL_SHM_FORMAT_XRGB8888,
+						     stride, width, height, data);
+	output->drag_cache_time = get_time_nsec();
+	if (!output->drag_cache)
+		output->drag_cache_disabled = true;
+
+	free(data);
+}
+
+static void output_render_clients(struct jwc_output *output, struct jwc_client *drag_client,
+				  pixman_region32_t *damage)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_renderer *renderer = output->server->renderer;
+
+	/* skip what is hidden behind opaque clients */
+	pixman_region32_t background;
+	pixman_region32_init(&background);
+	pixman_region32_copy(&background, damage);
+	client_occlude_all(output, &background);
+
+	/* default color in background */
+	float color[4] = {0.2, 0.2, 0.2, 1.0};
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&background, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		output_scissor(wlr_output, &rects[i]);
+		wlr_renderer_clear(renderer, color);
+	}
+	pixman_region32_fini(&background);
+
+	if (!drag_client) {
+		client_render_all(output);
+		return;
+	}
+
+	/* save the clients below the dragged one before drawing it, the
+	 * dragged one is the toplevel client (see output_get_drag_client)
+	 */
+	struct jwc_render_entry *clients;
+	int len;
+	pixman_region32_t drag_region;
+	pixman_region32_init(&drag_region);
+	clients = output_get_clients(output, &len);
+	if (clients[0].damaged)
+		pixman_region32_copy(&drag_region, &drag_client->render_region);
+	pixman_region32_clear(&drag_client->render_region);
+
+	client_render_all(output);
+	output_update_drag_cache(output);
+
+	pixman_region32_copy(&drag_client->render_region, &drag_region);
+	pixman_region32_fini(&drag_region);
+	client_render(output, drag_client);
+}
+
+static void output_render_drag_cache(struct jwc_output *output,
+				     struct jwc_client *drag_client,
+				     pixman_region32_t *damage)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_renderer *renderer = output->server->renderer;
+
+	/* the clients below have not changed, blit them */
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		output_scissor(wlr_output, &rects[i]);
+		wlr_render_texture(renderer, output->drag_cache,
+				   wlr_output->transform_matrix, 0, 0, 1);
+	}
+
+	/* and draw the dragged client over them */
+	pixman_region32_copy(&drag_client->render_region, damage);
+	client_render(output, drag_client);
+}
+
+static void output_render(struct jwc_output *output)
+{
+	struct jwc_server *server = output->server;
+	struct wlr_output *wlr_output = output->wlr_output;
 	struct wlr_renderer *renderer = server->renderer;
 
-	/* get current time */
-	struct timespec now;
-	clock_gettime(CLOCK_MONOTONIC, &now);
+	/* try to display a fullscreen client without composition */
+	if (output_scanout(output)) {
+		if (!output->scanout)
+			DEBUG("Direct scanout enabled on %s", wlr_output->name);
+		output->scanout = true;
+		return;
+	}
+
+	/* our buffers are outdated after a direct scanout */
+	if (output->scanout) {
+		DEBUG("Direct scanout disabled on %s", wlr_output->name);
+		wlr_output_damage_add_whole(output->damage);
+		output->scanout = false;
+	}
+
+	/* the drag cache is built from a full composite of the output */
+	struct jwc_client *drag_client = output_get_drag_client(output);
+	if (drag_client && !output->drag_cache)
+		wlr_output_damage_add_whole(output->damage);
+
+	/* make the output rendering context current and get the damage
+	 * accumulated since the buffer we are going to draw was displayed.
+	 */
+	bool needs_frame;
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	if (!wlr_output_damage_attach_render(output->damage, &needs_frame, &damage)) {
+		pixman_region32_fini(&damage);
+		return;
+	}
 
-	/* make the output rendering context current */
-	if (!wlr_output_attach_render(wlr_output, NULL))
+	/* nothing has changed on this output, keep the current buffer */
+	if (!needs_frame) {
+		pixman_region32_fini(&damage);
+		wlr_output_rollback(wlr_output);
 		return;
+	}
 
 	/* start rendering on all output frame*/
 	int width, height;
 	wlr_output_effective_resolution(wlr_output, &width, &height);
 	wlr_renderer_begin(renderer, width, height);
 
-	/* default color in background */
-	float color[4] = {0.2, 0.2, 0.2, 1.0};
-	wlr_renderer_clear(renderer, color);
-
-	/* update all client's surface of this output */
-	client_render_all(server, wlr_output, &now);
+	int64_t render_start = get_time_nsec();
+	if (pixman_region32_not_empty(&damage)) {
+		/* update all client's surface of this output */
+		if (drag_client && output->drag_cache)
+			output_render_drag_cache(output, drag_client, &damage);
+		else
+			output_render_clients(output, drag_client, &damage);
 
-	/* renders software cursors */
-	wlr_output_render_software_cursors(wlr_output, NULL);
+		/* renders software cursors */
+		wlr_output_render_software_cursors(wlr_output, &damage);
+	}
+	int64_t render_end = get_time_nsec();
+	stats_add(&output->render_hist, render_end - render_start);
 
 	/* Finish rendering */
+	wlr_renderer_scissor(renderer, NULL);
 	wlr_renderer_end(renderer);
-	wlr_output_commit(wlr_output);
+	pixman_region32_fini(&damage);
+
+	/* tell the backend which part of the buffer has changed */
+	pixman_region32_t frame_damage;
+	pixman_region32_init(&frame_damage);
+	wlr_output_transformed_resolution(wlr_output, &width, &height);
+	enum wl_output_transform transform = wlr_output_transform_invert(wlr_output->transform);
+	wlr_region_transform(&frame_damage, &output->damage->current, transform,
+			     width, height);
+	wlr_output_set_damage(wlr_output, &frame_damage);
+	pixman_region32_fini(&frame_damage);
+
+	if (!wlr_output_commit(wlr_output))
+		return;
+
+	output->commit_time = get_time_nsec();
+	stats_add(&output->commit_hist, output->commit_time - render_end);
+}
+
+static void output_update_adaptive_sync(struct jwc_output *output)
+{
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct jwc_render_entry *clients;
+	bool enabled;
+	int len;
+
+	switch (output->adaptive_sync) {
+	case OUTPUT_ADAPTIVE_SYNC_ON:
+		enabled = true;
+		break;
+	case OUTPUT_ADAPTIVE_SYNC_FULLSCREEN:
+		clients = output_get_clients(output, &len);
+		enabled = len > 0 && clients[0].fullscreen;
+		break;
+	default:
+		enabled = false;
+		break;
+	}
+
+	if (output->adaptive_sync_unsupported ||
+	    enabled == (wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED))
+		return;
+
+	/* committed on its own: pending with the frame, it would be lost when
+	 * nothing is rendered (rollback) or the scanout buffer is already shown.
+	 */
+	wlr_output_enable_adaptive_sync(wlr_output, enabled);
+	if (!wlr_output_test(wlr_output) || !wlr_output_commit(wlr_output)) {
+		INFO("Variable refresh rate not supported on %s", wlr_output->name);
+		wlr_output_rollback(wlr_output);
+		output->adaptive_sync_unsupported = true;
+		return;
+	}
+
+	INFO("Variable refresh rate %s on %s", enabled ? "enabled" : "disabled",
+	     wlr_output->name);
+}
+
+static void output_repaint(struct jwc_output *output)
+{
+	/* get current time */
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	output->repaint_pending = false;
+	if (!output->enabled)
+		return;
+
+	/* sample the latest pointer position */
+	cursor_flush(output->server);
+
+	/* tell the X server where its windows have been moved */
+	client_flush_configures(output->server);
+
+	output_update_adaptive_sync(output);
+	output_render(output);
+
+	/* software cursors are more expensive: damage on every motion */
+	bool hardware_cursor = output->wlr_output->hardware_cursor != NULL;
+	if (hardware_cursor != output->hardware_cursor) {
+		INFO("%s cursor on %s", hardware_cursor ? "Hardware" : "Software",
+		     output->wlr_output->name);
+		output->hardware_cursor = hardware_cursor;
+	}
+
+	/* save how long it took to render this frame */
+	output->render_times[output->render_times_idx] = get_time_nsec() -
+							 timespec_to_nsec(&now);
+	output->render_times_idx = (output->render_times_idx + 1) % OUTPUT_RENDER_TIMES;
+
+	/* let the clients displayed on this output draw their next frame */
+	client_send_frame_done_all(output, &now);
+}
+
+static void output_present(struct wl_listener *listener, void *data)
+{
+	struct jwc_output *output = wl_container_of(listener, output, present);
+	struct wlr_output_event_present *event = data;
+	int64_t present_time, period;
+
+	if (!event->presented || !event->when)
+		return;
+
+	present_time = timespec_to_nsec(event->when);
+	period = event->refresh;
+	output->frames++;
+
+	/* the frame has been displayed after the vblank following its commit */
+	if (period > 0 && present_time - output->commit_time > period)
+		output->missed_vblanks++;
+
+	/* only consecutive frames are meaningful, not idle periods */
+	if (output->present_time > 0 &&
+	    (period == 0 || output->commit_time - output->present_time < period))
+		stats_add(&output->interval_hist, present_time - output->present_time);
+
+	output->present_time = present_time;
+
+	/* the last buffer of the fullscreen client went out with this frame */
+	if (output->client_commit_time > 0 &&
+	    output->client_commit_time <= output->commit_time) {
+		stats_add(&output->latency_hist, present_time - output->client_commit_time);
+		output->client_commit_time = 0;
+	}
+
+	/* tell the clients when their content reached the screen */
+	struct wlr_presentation_event presentation_event = {
+		.output = output->wlr_output,
+		.tv_sec = (uint64_t)event->when->tv_sec,
+		.tv_nsec = (uint32_t)event->when->tv_nsec,
+		.refresh = (uint32_t)event->refresh,
+		.seq = (uint64_t)event->seq,
+		.flags = event->flags,
+	};
+	client_send_presented_all(output, &presentation_event);
+}
+
+static void output_client_commit_idle(void *data)
+{
+	struct jwc_output *output = data;
+
+	/* idle sources are removed once dispatched */
+	output->low_latency_idle = NULL;
+
+	/* a frame event may have displayed the buffer meanwhile */
+	if (!output->enabled || !output->low_latency || !output->scanout ||
+	    output->repaint_pending || output->wlr_output->frame_pending)
+		return;
+
+	output_repaint(output);
+}
+
+void output_client_commit(struct jwc_output *output, struct jwc_client *client)
+{
+	struct jwc_render_entry *clients;
+	int len;
+
+	clients = output_get_clients(output, &len);
+	if (len == 0 || clients[0].client != client || !clients[0].fullscreen)
+		return;
+
+	/* keep the oldest buffer not yet displayed */
+	if (output->client_commit_time == 0)
+		output->client_commit_time = get_time_nsec();
+
+	/* the buffer can only be flipped once the previous one is displayed,
+	 * otherwise it goes out with the next frame event.
+	 */
+	if (!output->enabled || !output->low_latency || !output->scanout ||
+	    output->repaint_pending || output->wlr_output->frame_pending)
+		return;
+
+	/* don't repaint (i.e. send pointer events and frame done to other
+	 * clients) from the commit signal of this client.
+	 */
+	if (!output->low_latency_idle)
+		output->low_latency_idle = wl_event_loop_add_idle(output->server->wl_event_loop,
+								  output_client_commit_idle,
+								  output);
+}
+
+void output_set_low_latency(struct jwc_output *output, bool enabled)
+{
+	if (output->low_latency == enabled)
+		return;
+
+	output->low_latency = enabled;
+	memset(&output->latency_hist, 0, sizeof(output->latency_hist));
+	output->client_commit_time = 0;
+
+	INFO("Low latency %s on %s", enabled ? "enabled" : "disabled",
+	     output->wlr_output->name);
+}
+
+static int output_repaint_timer(void *data)
+{
+	struct jwc_output *output = data;
+
+	output_repaint(output);
+
+	return 0;
+}
+
+static int output_get_max_render_time(struct jwc_output *output)
+{
+	int64_t max = 0;
+
+	if (output->max_render_time != OUTPUT_MAX_RENDER_TIME_ADAPTIVE)
+		return output->max_render_time;
+
+	/* slowest of the last frames, rounded up to the next millisecond */
+	for (int i = 0; i < OUTPUT_RENDER_TIMES; i++)
+		max = MAX(max, output->render_times[i]);
+
+	return (max + 999999) / 1000000 + output->render_margin;
+}
+
+/* frame events are only emitted by the output damage when something has
+ * been damaged or a frame has been explicitly scheduled on this output.
+ * The latter come from an idle callback, not from the vblank: the next
+ * vblank is predicted from the last presentation, rendering is delayed
+ * until just before it so that clients committing in the meantime are
+ * displayed with it.
+ */
+static int output_get_repaint_delay(struct jwc_output *output, int max_render_time)
+{
+	int64_t period = 1000000000000LL / output->wlr_output->refresh;
+	int64_t elapsed = get_time_nsec() - output->present_time;
+	int64_t until_vblank;
+
+	/* no vblank known since the output has been idle */
+	if (output->present_time == 0 || elapsed < 0 || elapsed > OUTPUT_VBLANK_MAX_AGE)
+		return 0;
+
+	until_vblank = period - elapsed % period;
+
+	return until_vblank / 1000000 - max_render_time;
 }
 
 static void output_frame(struct wl_listener *listener, void *data)
 {
 	struct jwc_output *output = wl_container_of(listener, output, frame);
+	int refresh = output->wlr_output->refresh;
+	int max_render_time, delay = 0;
+
+	if (!output->enabled || output->repaint_pending)
+		return;
+
+	/* refresh is in mHz, unknown for some backends.
+	 * With variable refresh rate, the vblank waits for our commit.
+	 * A scanned out client doesn't need any rendering time.
+	 */
+	max_render_time = output_get_max_render_time(output);
+	if (refresh > 0 && max_render_time != OUTPUT_MAX_RENDER_TIME_OFF &&
+	    output->wlr_output->adaptive_sync_status != WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED &&
+	    !(output->low_latency && output->scanout))
+		delay = output_get_repaint_delay(output, max_render_time);
+
+	if (delay < 1) {
+		output_repaint(output);
+		return;
+	}
+
+	output->repaint_pending = true;
+	wl_event_source_timer_update(output->repaint_timer, delay);
+}
+
+static struct wlr_output_configuration_v1 *output_get_configuration(struct jwc_server *server)
+{
+	struct wlr_output_configuration_v1 *config;
+	struct wlr_output_configuration_head_v1 *head;
+	struct jwc_output *output;
+	struct wlr_box *box;
+
+	config = wlr_output_configuration_v1_create();
+	if (!config)
+		return NULL;
+
+	/* mode, transform and scale are filled from the output state */
+	wl_list_for_each(output, &server->outputs, link) {
+		head = wlr_output_configuration_head_v1_create(config, output->wlr_output);
+		if (!head) {
+			wlr_output_configuration_v1_destroy(config);
+			return NULL;
+		}
+
+		head->state.enabled = output->enabled;
+		box = wlr_output_layout_get_box(server->output_layout, output->wlr_output);
+		if (box) {
+			head->state.x = box->x;
+			head->state.y = box->y;
+		}
+	}
+
+	return config;
+}
+
+static void output_update_manager(struct jwc_server *server)
+{
+	struct wlr_output_configuration_v1 *config = output_get_configuration(server);
+
+	if (config)
+		wlr_output_manager_v1_set_configuration(server->output_manager, config);
+}
+
+static void output_damage_destroy(struct wl_listener *listener, void *data)
+{
+	struct jwc_output *output = wl_container_of(listener, output, damage_destroy);
 
-	if (output->enabled)
-		output_render(output->server, output->wlr_output);
+	/* the damage helper is destroyed with the wlr_output, before us */
+	wl_list_remove(&output->frame.link);
+	wl_list_remove(&output->damage_destroy.link);
 }
 
 static void output_destroy(struct wl_listener *listener, void *data)
 {
 	struct jwc_output *output = wl_container_of(listener, output, destroy);
 	struct jwc_server *server = output->server;
+	struct jwc_client *client;
 
 	/* remove this output from the layout */
 	wlr_output_layout_remove(server->output_layout, output->wlr_output);
 
-	/* unregister listeners */
-	wl_list_remove(&output->frame.link);
+	/* stop pending repaint */
+	wl_event_source_remove(output->repaint_timer);
+	if (output->low_latency_idle)
+		wl_event_source_remove(output->low_latency_idle);
+
+	/* unregister listeners, frame is removed with the damage helper */
+	wl_list_remove(&output->present.link);
 	wl_list_remove(&output->destroy.link);
 
 	/* remove this output from the global list */
 	wl_list_remove(&output->link);
 
+	/* clients displayed on this output must not reference it anymore */
+	wl_list_for_each(client, &server->clients, link) {
+		if (client->output != output && !(client->output_mask & output->mask))
+			continue;
+
+		client->saved_mask &= ~output->mask;
+		client_update_outputs(client);
+	}
+
+	if (output->drag_cache)
+		wlr_texture_destroy(output->drag_cache);
+	free(output->clients);
 	free(output);
 
 	client_update_all(server);
+	output_damage_whole(server);
+	output_update_manager(server);
 }
 
 static struct jwc_output *output_get_primary(struct jwc_server *server)
@@ -127,6 +696,7 @@ static void output_auto_configure(struct jwc_server *server)
 
 	/* auto detect if we need to add/remove output in layout */
 	struct jwc_output *output;
+	bool added = false;
 	wl_list_for_each(output, outputs, link) {
 
 		if (output->enabled) {
@@ -136,6 +706,7 @@ static void output_auto_configure(struct jwc_server *server)
 
 			wlr_output_layout_add(server->output_layout, output->wlr_output,
 					      0, 0);
+			added = true;
 		} else {
 			/* check if this output is NOT in layout */
 			if (!wlr_output_layout_get(server->output_layout, output->wlr_output))
@@ -145,20 +716,308 @@ static void output_auto_configure(struct jwc_server *server)
 		}
 	}
 
-	/* all the output are moved from the left to the right.
+	/* keep the position requested by the user, the other outputs are
+	 * placed on their right so that they never overlap.
+	 */
+	int32_t width = 0, output_width, output_height;
+	wl_list_for_each(output, outputs, link) {
+		if (!output->enabled)
+			continue;
+
+		/* cursor theme must be ready before the pointer enters it */
+		cursor_load_scale(server, output->wlr_output->scale);
+
+		if (!output->positioned)
+			continue;
+
+		wlr_output_layout_move(server->output_layout, output->wlr_output,
+				       output->x, output->y);
+		wlr_output_effective_resolution(output->wlr_output, &output_width,
+						&output_height);
+		width = MAX(width, output->x + output_width);
+	}
+
+	/* all the other outputs are moved from the left to the right.
 	 * the primary output is placed at the "most" right.
 	 */
-	int32_t width = 0;
 	wl_list_for_each_reverse(output, outputs, link) {
-		if (output->enabled) {
-			wlr_output_layout_move(server->output_layout, output->wlr_output,
-					       width, 0);
-			width += output->wlr_output->width;
-		}
+		if (!output->enabled || output->positioned)
+			continue;
+
+		wlr_output_layout_move(server->output_layout, output->wlr_output,
+				       width, 0);
+		wlr_output_effective_resolution(output->wlr_output, &output_width,
+						&output_height);
+		width += output_width;
 	}
 
+	/* wlr_cursor doesn't set the last xcursor image on the new outputs */
+	if (added)
+		cursor_reset_image(server);
+
 	/* update client coordinates if needed */
 	client_update_all(server);
+
+	/* outputs have moved, repaint everything */
+	output_damage_whole(server);
+
+	/* advertise the new configuration */
+	output_update_manager(server);
+}
+
+static void output_rollback_configuration(struct wlr_output_configuration_v1 *config)
+{
+	struct wlr_output_configuration_head_v1 *head;
+
+	wl_list_for_each(head, &config->heads, link)
+		wlr_output_rollback(head->state.output);
+}
+
+/* area of the layout covered by an output once the head is applied */
+static void output_get_head_box(struct wlr_output_configuration_head_v1 *head,
+				struct wlr_box *box)
+{
+	int width, height, tmp;
+
+	if (head->state.mode) {
+		width = head->state.mode->width;
+		height = head->state.mode->height;
+	} else {
+		width = head->state.custom_mode.width;
+		height = head->state.custom_mode.height;
+	}
+
+	/* 90 and 270 degrees rotations swap the dimensions */
+	if (head->state.transform % 2 != 0) {
+		tmp = width;
+		width = height;
+		height = tmp;
+	}
+
+	box->x = head->state.x;
+	box->y = head->state.y;
+	box->width = width / head->state.scale;
+	box->height = height / head->state.scale;
+}
+
+/* enabled outputs of the configuration must not overlap each other */
+static bool output_test_layout(struct wlr_output_configuration_v1 *config)
+{
+	struct wlr_output_configuration_head_v1 *head, *other;
+	struct wlr_box box, other_box, intersection;
+
+	wl_list_for_each(head, &config->heads, link) {
+		if (!head->state.enabled)
+			continue;
+
+		output_get_head_box(head, &box);
+		wl_list_for_each(other, &config->heads, link) {
+			if (other == head)
+				break;
+			if (!other->state.enabled)
+				continue;
+
+			output_get_head_box(other, &other_box);
+			if (wlr_box_intersection(&intersection, &box, &other_box)) {
+				ERROR("Configuration overlaps %s and %s",
+				      head->state.output->name, other->state.output->name);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* set the pending state of every output of the configuration, then check
+ * that the backend accepts all of them before anything is committed.
+ * Nothing stays pending on failure.
+ */
+static bool output_test_configuration(struct wlr_output_configuration_v1 *config)
+{
+	struct wlr_output_configuration_head_v1 *head;
+	struct wlr_output *wlr_output;
+
+	/* an enabled output needs a mode, the custom one is not checked by
+	 * the protocol and may be missing or empty.
+	 */
+	wl_list_for_each(head, &config->heads, link) {
+		if (!head->state.enabled || head->state.mode)
+			continue;
+
+		if (head->state.custom_mode.width <= 0 ||
+		    head->state.custom_mode.height <= 0) {
+			ERROR("Configuration without mode for %s", head->state.output->name);
+			return false;
+		}
+	}
+
+	wl_list_for_each(head, &config->heads, link) {
+		wlr_output = head->state.output;
+		wlr_output_enable(wlr_output, head->state.enabled);
+
+		if (head->state.enabled) {
+			if (head->state.mode)
+				wlr_output_set_mode(wlr_output, head->state.mode);
+			else
+				wlr_output_set_custom_mode(wlr_output,
+							   head->state.custom_mode.width,
+							   head->state.custom_mode.height,
+							   head->state.custom_mode.refresh);
+			wlr_output_set_transform(wlr_output, head->state.transform);
+			wlr_output_set_scale(wlr_output, head->state.scale);
+		}
+	}
+
+	wl_list_for_each(head, &config->heads, link) {
+		if (!wlr_output_test(head->state.output)) {
+			ERROR("Configuration rejected by %s", head->state.output->name);
+			output_rollback_configuration(config);
+			return false;
+		}
+	}
+
+	if (!output_test_layout(config)) {
+		output_rollback_configuration(config);
+		return false;
+	}
+
+	return true;
+}
+
+static bool output_commit_head(struct wlr_output_configuration_head_v1 *head)
+{
+	struct jwc_output *output = head->state.output->data;
+
+	if (!wlr_output_commit(head->state.output)) {
+		ERROR("Failed to configure %s", head->state.output->name);
+		return false;
+	}
+
+	output->enabled = head->state.enabled;
+	output->positioned = true;
+	output->x = head->state.x;
+	output->y = head->state.y;
+
+	return true;
+}
+
+/* wlroots commits one output at a time: the outputs disabled are committed
+ * first to release their resources (i.e. CRTC) for the ones enabled.
+ */
+static bool output_commit_configuration(struct wlr_output_configuration_v1 *config)
+{
+	struct wlr_output_configuration_head_v1 *head;
+
+	wl_list_for_each(head, &config->heads, link) {
+		if (!head->state.enabled && !output_commit_head(head)) {
+			output_rollback_configuration(config);
+			return false;
+		}
+	}
+
+	wl_list_for_each(head, &config->heads, link) {
+		if (head->state.enabled && !output_commit_head(head)) {
+			output_rollback_configuration(config);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool output_apply_configuration(struct jwc_server *server,
+				       struct wlr_output_configuration_v1 *config)
+{
+	struct wlr_output_configuration_v1 *previous;
+	bool success;
+
+	if (!output_test_configuration(config))
+		return false;
+
+	/* a commit can still fail: go back to the previous configuration */
+	previous = output_get_configuration(server);
+	success = output_commit_configuration(config);
+	if (!success && previous &&
+	    !(output_test_configuration(previous) && output_commit_configuration(previous)))
+		ERROR("Failed to restore the previous output configuration");
+
+	if (previous)
+		wlr_output_configuration_v1_destroy(previous);
+
+	/* update layout, clients and outputs advertised */
+	output_auto_configure(server);
+
+	return success;
+}
+
+static void output_manager_apply(struct wl_listener *listener, void *data)
+{
+	struct jwc_server *server = wl_container_of(listener, server, output_manager_apply);
+	struct wlr_output_configuration_v1 *config = data;
+
+	if (output_apply_configuration(server, config))
+		wlr_output_configuration_v1_send_succeeded(config);
+	else
+		wlr_output_configuration_v1_send_failed(config);
+
+	wlr_output_configuration_v1_destroy(config);
+}
+
+static void output_manager_test(struct wl_listener *listener, void *data)
+{
+	struct wlr_output_configuration_v1 *config = data;
+
+	if (output_test_configuration(config)) {
+		output_rollback_configuration(config);
+		wlr_output_configuration_v1_send_succeeded(config);
+	} else {
+		wlr_output_configuration_v1_send_failed(config);
+	}
+
+	wlr_output_configuration_v1_destroy(config);
+}
+
+static uint32_t output_get_free_mask(struct jwc_server *server)
+{
+	struct jwc_output *output;
+	uint32_t used = 0;
+
+	wl_list_for_each(output, &server->outputs, link)
+		used |= output->mask;
+
+	/* lowest bit not used by other outputs, 0 when all of them are */
+	return ~used & (used + 1);
+}
+
+/* highest refresh rate at the native resolution of the panel */
+static struct wlr_output_mode *output_get_best_mode(struct wlr_output *wlr_output)
+{
+	struct wlr_output_mode *mode, *native = NULL, *best = NULL;
+
+	if (wl_list_empty(&wlr_output->modes))
+		return NULL;
+
+	/* native resolution is the preferred mode, otherwise the biggest one */
+	wl_list_for_each(mode, &wlr_output->modes, link) {
+		if (mode->preferred) {
+			native = mode;
+			break;
+		}
+
+		if (!native || mode->width * mode->height > native->width * native->height)
+			native = mode;
+	}
+
+	wl_list_for_each(mode, &wlr_output->modes, link) {
+		if (mode->width != native->width || mode->height != native->height)
+			continue;
+
+		if (!best || mode->refresh > best->refresh)
+			best = mode;
+	}
+
+	return best;
 }
 
 static void output_notify_new(struct wl_listener *listener, void *data)
@@ -166,10 +1025,18 @@ static void output_notify_new(struct wl_listener *listener, void *data)
 	struct jwc_server *server = wl_container_of(listener, server, new_output);
 	struct wlr_output *wlr_output = data;
 
+	/* clients can't tell on which outputs they are displayed without a bit */
+	uint32_t mask = output_get_free_mask(server);
+	if (mask == 0) {
+		ERROR("Too many outputs, %s is not used", wlr_output->name);
+		return;
+	}
+
 	/* set default Modesetting */
-	if (!wl_list_empty(&wlr_output->modes)) {
-		struct wlr_output_mode *mode =
-			wl_container_of(wlr_output->modes.prev, mode, link);
+	struct wlr_output_mode *mode = output_get_best_mode(wlr_output);
+	if (mode) {
+		INFO("Mode %dx%d@%dmHz on %s", mode->width, mode->height, mode->refresh,
+		     wlr_output->name);
 		wlr_output_set_mode(wlr_output, mode);
 	}
 
@@ -177,11 +1044,32 @@ static void output_notify_new(struct wl_listener *listener, void *data)
 	struct jwc_output *output = calloc(1, sizeof(struct jwc_output));
 	output->server = server;
 	output->wlr_output = wlr_output;
+	output->damage = wlr_output_damage_create(wlr_output);
+	output->mask = mask;
+	output->clients_dirty = true;
 	output->enabled = true;
+	wlr_output->data = output;
+
+	/* render deadline of this output */
+	const struct output_config *config = output_get_config(wlr_output->name);
+	output->max_render_time = config->max_render_time;
+	output->render_margin = config->render_margin;
+	output->adaptive_sync = config->adaptive_sync;
+	output->low_latency = config->low_latency;
+	output->repaint_timer = wl_event_loop_add_timer(server->wl_event_loop,
+							output_repaint_timer, output);
 
-	/* register callback when we get frame events from this output */
+	/* register callback when this output needs a new frame */
 	output->frame.notify = output_frame;
-	wl_signal_add(&wlr_output->events.frame, &output->frame);
+	wl_signal_add(&output->damage->events.frame, &output->frame);
+
+	/* register callback when the damage helper goes away with the output */
+	output->damage_destroy.notify = output_damage_destroy;
+	wl_signal_add(&output->damage->events.destroy, &output->damage_destroy);
+
+	/* register callback when a frame has been displayed */
+	output->present.notify = output_present;
+	wl_signal_add(&wlr_output->events.present, &output->present);
 
 	/* register callback when we an output has been removed */
 	output->destroy.notify = output_destroy;
@@ -197,33 +1085,97 @@ static void output_notify_new(struct wl_listener *listener, void *data)
 	wlr_output_create_global(wlr_output);
 }
 
-static struct wlr_output *output_get_layout_output_at(struct jwc_server *server, double x, double y)
+static struct wlr_box *output_get_box(struct jwc_output *output)
 {
-	return wlr_output_layout_output_at(server->output_layout, x, y);
+	struct jwc_server *server = output->server;
+	struct wlr_box *box;
+
+	if (output->box_valid) {
+		server->output_cache.hits++;
+		return &output->box;
+	}
+
+	/* an output out of the layout covers nothing */
+	server->output_cache.misses++;
+	box = wlr_output_layout_get_box(server->output_layout, output->wlr_output);
+	if (box) {
+		output->box = *box;
+	} else {
+		output->box.x = 0;
+		output->box.y = 0;
+		output->box.width = 0;
+		output->box.height = 0;
+	}
+	output->box_valid = true;
+
+	return &output->box;
+}
+
+static struct jwc_output *output_get_layout_output_at(struct jwc_server *server, double x, double y)
+{
+	struct jwc_output *output;
+
+	wl_list_for_each(output, &server->outputs, link) {
+		if (wlr_box_contains_point(output_get_box(output), x, y))
+			return output;
+	}
+
+	return NULL;
 }
 
 struct wlr_output *output_get_output_at(struct jwc_server *server, double x, double y)
 {
-	return output_get_layout_output_at(server, x, y);
+	struct jwc_output *output = output_get_layout_output_at(server, x, y);
+
+	return output ? output->wlr_output : NULL;
 }
 
 void output_get_output_geo_at(struct jwc_server *server, double x, double y, struct wlr_box *box)
 {
-	struct wlr_output_layout_output *layout_output;
-	struct wlr_output *output = output_get_layout_output_at(server, x, y);
+	struct jwc_output *output = output_get_layout_output_at(server, x, y);
+	struct wlr_box *output_box;
 
 	if (output) {
-		layout_output = wlr_output_layout_get(server->output_layout, output);
-		box->x = layout_output->x;
-		box->y = layout_output->y;
-		box->width = output->width;
-		box->height = output->height;
+		output_box = output_get_box(output);
+		box->x = output_box->x;
+		box->y = output_box->y;
+		box->width = output->wlr_output->width;
+		box->height = output->wlr_output->height;
 	}
 }
 
 struct wlr_box *output_get_layout(struct jwc_server *server)
 {
-	return wlr_output_layout_get_box(server->output_layout, NULL);
+	if (server->layout_box_valid) {
+		server->layout_cache.hits++;
+		return &server->layout_box;
+	}
+
+	server->layout_cache.misses++;
+	server->layout_box = *wlr_output_layout_get_box(server->output_layout, NULL);
+	server->layout_box_valid = true;
+
+	return &server->layout_box;
+}
+
+static void output_layout_change(struct wl_listener *listener, void *data)
+{
+	struct jwc_server *server = wl_container_of(listener, server, output_layout_change);
+	struct jwc_output *output;
+
+	/* an output has been added, moved, removed or its mode has changed */
+	server->layout_box_valid = false;
+	wl_list_for_each(output, &server->outputs, link)
+		output->box_valid = false;
+}
+
+static int output_stats_signal(int signal_number, void *data)
+{
+	output_print_stats(data);
+	cursor_print_stats(data);
+	transaction_print_stats(data);
+	client_print_stats(data);
+	return 0;
 }
 
 void output_init(struct jwc_server *server)
@@ -236,6 +1188,38 @@ void output_init(struct jwc_server *server)
 
 	/* create layout, it will be used to describe how the screens are organized */
 	server->output_layout = wlr_output_layout_create();
+	server->output_layout_change.notify = output_layout_change;
+	wl_signal_add(&server->output_layout->events.change, &server->output_layout_change);
+
+	/* let clients (i.e. kanshi, wlr-randr) configure the outputs */
+	server->output_manager = wlr_output_manager_v1_create(server->wl_display);
+	server->output_manager_apply.notify = output_manager_apply;
+	wl_signal_add(&server->output_manager->events.apply, &server->output_manager_apply);
+	server->output_manager_test.notify = output_manager_test;
+	wl_signal_add(&server->output_manager->events.test, &server->output_manager_test);
+
+	/* dump frame timings in the log on SIGUSR1 */
+	wl_event_loop_add_signal(server->wl_event_loop, SIGUSR1,
+				 output_stats_signal, server);
+}
+
+void output_print_stats(struct jwc_server *server)
+{
+	struct jwc_output *output;
+
+	wl_list_for_each(output, &server->outputs, link) {
+		INFO("Output %s: %llu frames, %llu missed vblanks", output->wlr_output->name,
+		     (unsigned long long)output->frames,
+		     (unsigned long long)output->missed_vblanks);
+		stats_print(&output->render_hist, "render");
+		stats_print(&output->commit_hist, "commit");
+		stats_print(&output->interval_hist, "interval");
+		stats_print(&output->latency_hist, "fullscreen latency");
+	}
+
+	INFO("Geometry caches:");
+	stats_print_cache(&server->layout_cache, "layout");
+	stats_print_cache(&server->output_cache, "output");
 }
 
 void output_enable(struct jwc_server *server, const char *name, bool enabled)
@@ -254,3 +1238,203 @@ void output_enable(struct jwc_server *server, const char *name, bool enabled)
 
 	output_auto_configure(server);
 }
+
+uint32_t output_get_mask(struct jwc_server *server, struct wlr_box *box)
+{
+	struct jwc_output *output;
+	struct wlr_box intersection;
+	uint32_t mask = 0;
+
+	wl_list_for_each(output, &server->outputs, link) {
+		if (wlr_box_intersection(&intersection, output_get_box(output), box))
+			mask |= output->mask;
+	}
+
+	return mask;
+}
+
+struct jwc_output *output_get_primary_at(struct jwc_server *server, struct wlr_box *box)
+{
+	struct jwc_output *output, *primary = NULL;
+	struct wlr_box *output_box, intersection;
+	int area, max_area = 0;
+
+	wl_list_for_each(output, &server->outputs, link) {
+		if (!output->enabled)
+			continue;
+
+		output_box = output_get_box(output);
+		if (!wlr_box_intersection(&intersection, output_box, box))
+			continue;
+
+		area = intersection.width * intersection.height;
+		if (area > max_area) {
+			max_area = area;
+			primary = output;
+		}
+	}
+
+	return primary;
+}
+
+void output_set_clients_dirty(struct jwc_server *server, uint32_t mask)
+{
+	struct jwc_output *output;
+
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output->mask & mask)
+			output->clients_dirty = true;
+	}
+}
+
+static void output_fill_entry(struct jwc_output *output, struct jwc_render_entry *entry,
+			      struct jwc_client *client)
+{
+	entry->client = client;
+	/* clients held by a transaction are displayed as they were */
+	entry->extents = client->in_transaction ? client->saved_extents : client->extents;
+	entry->alpha = client->alpha;
+	entry->fullscreen = client->fullscreen;
+	entry->primary = client->output == output;
+}
+
+/* outputs without a bit are rejected by output_notify_new() */
+static int output_get_bit(struct jwc_output *output)
+{
+	/* __builtin_ctz(0) is undefined */
+	assert(output->mask != 0);
+	return __builtin_ctz(output->mask);
+}
+
+static void output_update_clients(struct jwc_output *output)
+{
+	struct jwc_client *client;
+	int bit = output_get_bit(output);
+	int len = 0;
+
+	/* keep the stacking order of the server clients list */
+	wl_list_for_each(client, &output->server->clients, link) {
+
+		if (!(client->output_mask & output->mask))
+			continue;
+
+		if (len == output->clients_size) {
+			int size = output->clients_size ? output->clients_size * 2 : 16;
+			struct jwc_render_entry *clients = realloc(output->clients,
+								   size * sizeof(*clients));
+			if (!clients) {
+				ERROR("Failed to allocate clients of %s",
+				      output->wlr_output->name);
+				break;
+			}
+			output->clients = clients;
+			output->clients_size = size;
+		}
+
+		client->output_entries[bit] = len;
+		output_fill_entry(output, &output->clients[len++], client);
+	}
+
+	output->clients_len = len;
+	output->clients_dirty = false;
+}
+
+void output_update_client(struct jwc_client *client)
+{
+	struct jwc_output *output;
+
+	wl_list_for_each(output, &client->server->outputs, link) {
+		if (!(output->mask & client->output_mask) || output->clients_dirty)
+			continue;
+
+		int i = client->output_entries[output_get_bit(output)];
+		if (i < output->clients_len && output->clients[i].client == client)
+			output_fill_entry(output, &output->clients[i], client);
+	}
+}
+
+struct jwc_render_entry *output_get_clients(struct jwc_output *output, int *len)
+{
+	if (output->clients_dirty)
+		output_update_clients(output);
+
+	*len = output->clients_len;
+	return output->clients;
+}
+
+void output_damage_region(struct jwc_server *server, pixman_region32_t *region)
+{
+	struct wlr_output_layout_output *layout_output;
+	struct jwc_output *output;
+	pixman_region32_t damage;
+
+	wl_list_for_each(output, &server->outputs, link) {
+		if (!output->enabled)
+			continue;
+
+		layout_output = wlr_output_layout_get(server->output_layout,
+						      output->wlr_output);
+		if (!layout_output)
+			continue;
+
+		/* convert layout coordinates to output coordinates */
+		pixman_region32_init(&damage);
+		pixman_region32_copy(&damage, region);
+		pixman_region32_translate(&damage, -layout_output->x, -layout_output->y);
+		wlr_output_damage_add(output->damage, &damage);
+		pixman_region32_fini(&damage);
+	}
+}
+
+void output_damage_box(struct jwc_server *server, struct wlr_box *box)
+{
+	pixman_region32_t damage;
+
+	pixman_region32_init_rect(&damage, box->x, box->y, box->width, box->height);
+	output_damage_region(server, &damage);
+	pixman_region32_fini(&damage);
+}
+
+void output_set_drag_client(struct jwc_server *server, struct jwc_client *client)
+{
+	struct jwc_output *output;
+
+	server->drag_client = client;
+
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output->drag_cache) {
+			wlr_texture_destroy(output->drag_cache);
+			output->drag_cache = NULL;
+		}
+		output->drag_cache_disabled = false;
+	}
+}
+
+void output_invalidate_drag_cache(struct jwc_server *server, uint32_t mask)
+{
+	struct jwc_output *output;
+
+	wl_list_for_each(output, &server->outputs, link) {
+		if (!(output->mask & mask) || !output->drag_cache)
+			continue;
+
+		/* the clients below keep changing (i.e. video): stop caching */
+		if (get_time_nsec() - output->drag_cache_time < OUTPUT_DRAG_CACHE_MIN_LIFETIME)
+			output->drag_cache_disabled = true;
+
+		wlr_texture_destroy(output->drag_cache);
+		output->drag_cache = NULL;
+	}
+}
+
+void output_damage_whole(struct jwc_server *server)
+{
+	struct jwc_output *output;
+
+	output_invalidate_drag_cache(server, ~0);
+
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output->enabled)
+			wlr_output_damage_add_whole(output->damage);
+	}
+}
@@ -21,16 +21,126 @@
 #define OUTPUT_H
 
 #include "server.h"
+#include "stats.h"
 
 #define DEFAULT_PRIMARY_OUTPUT "eDP-1"
 
+/* time reserved to render a frame before the vblank (in ms):
+ * adaptive mode measures the last render durations and adds a margin,
+ * off renders as soon as the previous frame has been displayed.
+ */
+#define OUTPUT_MAX_RENDER_TIME_ADAPTIVE	-1
+#define OUTPUT_MAX_RENDER_TIME_OFF	0
+#define OUTPUT_RENDER_TIMES		32
+
+/* the next vblank is predicted from presentations younger than this (in ns) */
+#define OUTPUT_VBLANK_MAX_AGE		1000000000
+
+/* variable refresh rate policy */
+enum output_adaptive_sync {
+	OUTPUT_ADAPTIVE_SYNC_OFF,
+	OUTPUT_ADAPTIVE_SYNC_ON,
+	OUTPUT_ADAPTIVE_SYNC_FULLSCREEN,
+};
+
+/* outputs are identified by a bit of the clients output_mask */
+#define OUTPUT_MAX			32
+
+/* drag cache rebuilt faster than this (in ns) is not worth it */
+#define OUTPUT_DRAG_CACHE_MIN_LIFETIME	100000000
+
+/* what the render loop needs to know about a client displayed on an output,
+ * copied from the client to avoid going through it for the clients skipped.
+ */
+struct jwc_render_entry {
+	struct jwc_client *client;
+	struct wlr_box extents;
+	float alpha;
+	bool fullscreen;
+	bool primary;
+
+	/* something to repaint in the frame being rendered, see client_occlude_all() */
+	bool damaged;
+};
+
+struct jwc_output {
+	/* pointer to compositor server */
+	struct jwc_server *server;
+
+	/* index in outputs list */
+	struct wl_list link;
+
+	/* Wayland listeners */
+	struct wl_listener frame;
+	struct wl_listener present;
+	struct wl_listener destroy;
+	struct wl_listener damage_destroy;
+
+	/* output ressources */
+	struct wlr_output *wlr_output;
+	struct wlr_output_damage *damage;
+	bool enabled;
+	bool scanout;
+	bool hardware_cursor;
+
+	/* position in the layout set by an output configuration client,
+	 * otherwise outputs are placed from the left to the right.
+	 */
+	bool positioned;
+	int x, y;
+
+	/* box in the layout, computed again after the layout has changed */
+	struct wlr_box box;
+	bool box_valid;
+
+	/* deadline scheduling: delay rendering as close as possible to vblank */
+	struct wl_event_source *repaint_timer;
+	bool repaint_pending;
+	int max_render_time, render_margin;
+	int64_t render_times[OUTPUT_RENDER_TIMES];
+	int render_times_idx;
+	int64_t present_time;
+
+	/* variable refresh rate, enabled while a fullscreen client is shown */
+	enum output_adaptive_sync adaptive_sync;
+	bool adaptive_sync_unsupported;
+
+	/* a fullscreen client scanned out is presented as soon as it commits,
+	 * from an idle callback once its commit has been handled.
+	 */
+	bool low_latency;
+	struct wl_event_source *low_latency_idle;
+
+	/* frame timings */
+	struct jwc_histogram render_hist, commit_hist, interval_hist;
+	uint64_t frames, missed_vblanks;
+	int64_t commit_time;
+
+	/* fullscreen client commit to present latency */
+	struct jwc_histogram latency_hist;
+	int64_t client_commit_time;
+
+	/* composite of the clients below the dragged one */
+	struct wlr_texture *drag_cache;
+	int64_t drag_cache_time;
+	bool drag_cache_disabled;
+
+	/* bit identifying this output in the clients output_mask */
+	uint32_t mask;
+
+	/* clients displayed on this output, from the toplevel one */
+	struct jwc_render_entry *clients;
+	int clients_len, clients_size;
+	bool clients_dirty;
+};
+
 /**
  * TODO
  */
 void output_init(struct jwc_server *server);
 
 /**
- * TODO
+ * Get the box of the whole layout, cached until the layout changes
  */
 struct wlr_box *output_get_layout(struct jwc_server *server);
 
@@ -46,4 +156,60 @@ void output_get_output_geo_at(struct jwc_server *server, double x, double y,
  */
 void output_enable(struct jwc_server *server, const char *name, bool enabled);
 
+/**
+ * Print the frame timings of all outputs in the log
+ */
+void output_print_stats(struct jwc_server *server);
+
+/**
+ * Get the mask of the outputs intersecting box (layout coordinates)
+ */
+uint32_t output_get_mask(struct jwc_server *server, struct wlr_box *box);
+
+/**
+ * Get the enabled output displaying the biggest part of box (layout coordinates)
+ */
+struct jwc_output *output_get_primary_at(struct jwc_server *server, struct wlr_box *box);
+
+/**
+ * Clients displayed on an output are only computed when the outputs flagged
+ * by mask need them, i.e. after a client has entered/left them or been
+ * restacked. Otherwise only the entry of the client is refreshed.
+ */
+void output_set_clients_dirty(struct jwc_server *server, uint32_t mask);
+void output_update_client(struct jwc_client *client);
+struct jwc_render_entry *output_get_clients(struct jwc_output *output, int *len);
+
+/**
+ * Accumulate damage (in layout coordinates) on every output it intersects,
+ * only the damaged area will be repainted on the next frame.
+ */
+void output_damage_whole(struct jwc_server *server);
+void output_damage_box(struct jwc_server *server, struct wlr_box *box);
+void output_damage_region(struct jwc_server *server, pixman_region32_t *region);
+
+/**
+ * During an interactive move, the clients below the dragged one are
+ * composited once per output and reused until one of them changes.
+ */
+void output_set_drag_client(struct jwc_server *server, struct jwc_client *client);
+void output_invalidate_drag_cache(struct jwc_server *server, uint32_t mask);
+
+/**
+ * A fullscreen client has committed a new buffer: measure how long it takes
+ * to reach the screen and, on low latency outputs, present it right away.
+ */
+void output_client_commit(struct jwc_output *output, struct jwc_client *client);
+
+/**
+ * Toggle the low latency mode of an output. The fullscreen latency is
+ * measured again from scratch, so that each mode can be compared.
+ */
+void output_set_low_latency(struct jwc_output *output, bool enabled);
+
+/**
+ * Restrict rendering to a rectangle of the output damage
+ */
+void output_scissor(struct wlr_output *wlr_output, pixman_box32_t *rect);
+
 #endif
@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <linux/input-event-codes.h>
+#include <pixman.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,17 +30,40 @@
 #include <wayland-server.h>
 #include <wlr/backend.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/types/wlr_matrix.h>
+#include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_output_management_v1.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_output_v1.h>
 #include <wlr/types/wlr_xdg_shell_v6.h>
 #include <wlr/util/log.h>
+#include <wlr/util/region.h>
 #include <wlr/xwayland.h>
 
+#include "stats.h"
+
+/* buckets of the surface to client index, see client_get_from_surface().
+ * Clients stay indexed until destroyed. The table is not resized: a lookup
+ * walks clients / CLIENT_SURFACE_BUCKETS entries on average, which stays
+ * constant up to a few hundred clients.
+ */
+#define CLIENT_SURFACE_BUCKETS 256
+
+/* scroll accumulated on one axis until the pointer events are processed */
+struct jwc_cursor_axis {
+	bool pending;
+	uint32_t time;
+	enum wlr_axis_source source;
+	double delta;
+	int32_t delta_discrete;
+};
+
 struct jwc_server {
 	/* Wayland resources */
 	struct wl_display *wl_display;
@@ -50,11 +74,19 @@ struct jwc_server {
 	struct wlr_renderer *renderer;
 	struct wlr_compositor *compositor;
 	struct wlr_seat *seat;
+	struct wlr_presentation *presentation;
 
 	/* Output resources */
 	struct wlr_output_layout *output_layout;
 	struct wl_list outputs;
 	struct wl_listener new_output;
+	struct wlr_output_manager_v1 *output_manager;
+	struct wl_listener output_manager_apply;
+	struct wl_listener output_manager_test;
+	struct wl_listener output_layout_change;
+	struct wlr_box layout_box;
+	bool layout_box_valid;
+	struct jwc_cache_stats layout_cache, output_cache;
 
 	/* input ressources */
 	struct wl_listener new_input;
@@ -62,6 +94,7 @@ struct jwc_server {
 	/* cursor ressources */
 	struct wlr_cursor *cursor;
 	struct wlr_xcursor_manager *cursor_mgr;
+	const char *cursor_image;
 	struct wl_listener cursor_motion;
 	struct wl_listener cursor_motion_absolute;
 	struct wl_listener cursor_button;
@@ -72,6 +105,16 @@ struct jwc_server {
 	bool cursor_button_right_pressed;
 	bool cursor_button_right_released;
 	struct wlr_input_device *cursor_input;
+	struct wl_event_source *cursor_idle;
+	bool cursor_coalesce;
+	bool cursor_motion_pending;
+	double cursor_motion_x, cursor_motion_y;
+	uint32_t cursor_motion_time;
+	struct jwc_cursor_axis cursor_axis_pending[2];
+
+	/* pointer motion received and processed, see cursor_print_stats() */
+	uint64_t motion_events, motion_handled;
+	struct jwc_histogram motion_hist;
 
 	/* keyboard ressources */
 	struct wl_list keyboards;
@@ -79,10 +122,17 @@ struct jwc_server {
 
 	/* clients resources */
 	struct wl_list clients;
+	struct wl_list client_surfaces[CLIENT_SURFACE_BUCKETS];
+	struct jwc_grid *client_grid;
+	bool clients_stack_dirty;
+	struct jwc_client *drag_client;
+	struct jwc_transaction *transaction;
 	struct wlr_xdg_shell_v6 *xdg_shell_v6;
 	struct wlr_xwayland *xwayland;
 	struct wl_listener xdg_shell_v6_new_surface;
 	struct wl_listener xwayland_new_surface;
+	struct wl_list xwayland_configures;
+	struct jwc_cache_stats client_cache;
 };
 
 #endif
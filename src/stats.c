@@ -0,0 +1,135 @@
+/*
+ * This file is part of the jwm distribution:
+ * https://github.com/JulienMasson/jwc
+ *
+ * Copyright (c) 2019 Julien Masson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+#include "utils.h"
+
+void stats_add(struct jwc_histogram *hist, int64_t nsec)
+{
+	int64_t bucket = nsec / STATS_BUCKET_NSEC;
+
+	if (nsec < 0)
+		return;
+
+	if (bucket >= STATS_BUCKETS)
+		bucket = STATS_BUCKETS - 1;
+
+	hist->buckets[bucket]++;
+	hist->count++;
+	hist->max = MAX(hist->max, nsec);
+}
+
+int64_t stats_percentile(struct jwc_histogram *hist, int percent)
+{
+	uint64_t target, sum = 0;
+
+	if (hist->count == 0)
+		return 0;
+
+	/* rank of the sample we are looking for */
+	target = (hist->count * percent + 99) / 100;
+
+	for (int i = 0; i < STATS_BUCKETS - 1; i++) {
+		sum += hist->buckets[i];
+		if (sum >= target)
+			return MIN((int64_t)(i + 1) * STATS_BUCKET_NSEC, hist->max);
+	}
+
+	return hist->max;
+}
+
+void stats_print(struct jwc_histogram *hist, const char *name)
+{
+	INFO("  %-10s count %8llu  p50 %6.2fms  p99 %6.2fms  max %6.2fms", name,
+	     (unsigned long long)hist->count,
+	     stats_percentile(hist, 50) / 1000000.0,
+	     stats_percentile(hist, 99) / 1000000.0,
+	     hist->max / 1000000.0);
+}
+
+static int stats_log_bucket(int64_t nsec)
+{
+	int shift, sub, bucket;
+
+	if (nsec < (1LL << STATS_LOG_MIN_SHIFT))
+		return 0;
+
+	/* power of two, then the next bits select the bucket inside it */
+	shift = 63 - __builtin_clzll(nsec);
+	sub = (nsec >> (shift - STATS_LOG_SUB_BITS)) & ((1 << STATS_LOG_SUB_BITS) - 1);
+	bucket = ((shift - STATS_LOG_MIN_SHIFT) << STATS_LOG_SUB_BITS) + sub;
+
+	return MIN(bucket, STATS_LOG_BUCKETS - 1);
+}
+
+static int64_t stats_log_bucket_end(int bucket)
+{
+	int shift = STATS_LOG_MIN_SHIFT + (bucket >> STATS_LOG_SUB_BITS);
+	int64_t sub = bucket & ((1 << STATS_LOG_SUB_BITS) - 1);
+
+	return ((1LL << STATS_LOG_SUB_BITS) + sub + 1) << (shift - STATS_LOG_SUB_BITS);
+}
+
+void stats_log_add(struct jwc_log_histogram *hist, int64_t nsec)
+{
+	if (nsec < 0)
+		return;
+
+	hist->buckets[stats_log_bucket(nsec)]++;
+	hist->count++;
+	hist->max = MAX(hist->max, nsec);
+}
+
+int64_t stats_log_percentile(struct jwc_log_histogram *hist, int percent)
+{
+	uint64_t target, sum = 0;
+
+	if (hist->count == 0)
+		return 0;
+
+	/* rank of the sample we are looking for */
+	target = ((uint64_t)hist->count * percent + 99) / 100;
+
+	for (int i = 0; i < STATS_LOG_BUCKETS - 1; i++) {
+		sum += hist->buckets[i];
+		if (sum >= target)
+			return MIN(stats_log_bucket_end(i), hist->max);
+	}
+
+	return hist->max;
+}
+
+void stats_log_print(struct jwc_log_histogram *hist, const char *name)
+{
+	INFO("  %-10s count %8llu  p50 %6.2fms  p99 %6.2fms  max %6.2fms", name,
+	     (unsigned long long)hist->count,
+	     stats_log_percentile(hist, 50) / 1000000.0,
+	     stats_log_percentile(hist, 99) / 1000000.0,
+	     hist->max / 1000000.0);
+}
+
+void stats_print_cache(struct jwc_cache_stats *cache, const char *name)
+{
+	uint64_t total = cache->hits + cache->misses;
+
+	INFO("  %-10s hits %9llu  misses %8llu  hit rate %5.1f%%", name,
+	     (unsigned long long)cache->hits,
+	     (unsigned long long)cache->misses,
+	     total ? cache->hits * 100.0 / total : 0.0);
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of the jwm distribution:
+ * https://github.com/JulienMasson/jwc
+ *
+ * Copyright (c) 2019 Julien Masson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/* latency histogram with fixed buckets of 100us, the last one holds
+ * everything above 25.5ms
+ */
+#define STATS_BUCKET_NSEC	100000
+#define STATS_BUCKETS		256
+
+struct jwc_histogram {
+	uint64_t buckets[STATS_BUCKETS];
+	uint64_t count;
+	int64_t max;
+};
+
+/* latency histogram for durations spread over several orders of magnitude
+ * (i.e. waiting for clients): 4 buckets per power of two from 64us, the
+ * last one holds everything above 4.3s. Estimations are within 25%.
+ */
+#define STATS_LOG_MIN_SHIFT	16
+#define STATS_LOG_SUB_BITS	2
+#define STATS_LOG_BUCKETS	64
+
+struct jwc_log_histogram {
+	uint32_t buckets[STATS_LOG_BUCKETS];
+	uint32_t count;
+	int64_t max;
+};
+
+/* lookups answered by a geometry cache */
+struct jwc_cache_stats {
+	uint64_t hits, misses;
+};
+
+/**
+ * Record a duration (in nanoseconds)
+ */
+void stats_add(struct jwc_histogram *hist, int64_t nsec);
+
+/**
+ * Get an estimation of the duration below which percent of the samples are
+ */
+int64_t stats_percentile(struct jwc_histogram *hist, int percent);
+
+/**
+ * Print count, p50, p99 and max of the histogram in the log
+ */
+void stats_print(struct jwc_histogram *hist, const char *name);
+
+/**
+ * Same as above for the log-scale histogram
+ */
+void stats_log_add(struct jwc_log_histogram *hist, int64_t nsec);
+int64_t stats_log_percentile(struct jwc_log_histogram *hist, int percent);
+void stats_log_print(struct jwc_log_histogram *hist, const char *name);
+
+/**
+ * Print the hits and misses of a cache in the log
+ */
+void stats_print_cache(struct jwc_cache_stats *cache, const char *name);
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * This file is part of the jwm distribution:
+ * https://github.com/JulienMasson/jwc
+ *
+ * Copyright (c) 2019 Julien Masson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "transaction.h"
+#include "client.h"
+#include "output.h"
+#include "utils.h"
+
+static void transaction_release(struct jwc_transaction *transaction, bool timeout)
+{
+	struct jwc_server *server = transaction->server;
+	struct jwc_client *client;
+
+	stats_log_add(&transaction->wait_hist, get_time_nsec() - transaction->start);
+	transaction->count++;
+	wl_event_source_timer_update(transaction->timer, 0);
+
+	/* don't wait anymore for the late clients */
+	if (timeout)
+		transaction->timeouts++;
+	transaction->clients = 0;
+	transaction->pending = 0;
+
+	/* display the new state of all the clients in the same frame */
+	wl_list_for_each(client, &server->clients, link) {
+		if (!client->in_transaction)
+			continue;
+
+		client->in_transaction = false;
+		client->transaction_pending = false;
+		client_drop_saved_buffers(client);
+		client_update_outputs(client);
+		client_damage_whole(client);
+	}
+}
+
+static int transaction_timeout(void *data)
+{
+	struct jwc_transaction *transaction = data;
+
+	INFO("Transaction timeout: %d clients not ready", transaction->pending);
+	transaction_release(transaction, true);
+
+	return 0;
+}
+
+void transaction_init(struct jwc_server *server)
+{
+	struct jwc_transaction *transaction = calloc(1, sizeof(struct jwc_transaction));
+	assert(transaction);
+
+	transaction->server = server;
+	transaction->timer = wl_event_loop_add_timer(server->wl_event_loop,
+						     transaction_timeout, transaction);
+	server->transaction = transaction;
+}
+
+void transaction_begin(struct jwc_server *server)
+{
+	server->transaction->depth++;
+}
+
+void transaction_commit(struct jwc_server *server)
+{
+	struct jwc_transaction *transaction = server->transaction;
+
+	if (--transaction->depth > 0)
+		return;
+
+	/* the clients may have been fast enough, or have only been moved */
+	if (transaction->pending == 0 && transaction->clients > 0)
+		transaction_release(transaction, false);
+}
+
+void transaction_add_client(struct jwc_client *client)
+{
+	struct jwc_transaction *transaction = client->server->transaction;
+
+	if (transaction->depth == 0 || client->in_transaction)
+		return;
+
+	/* nothing displayed to keep */
+	if (!client->mapped || !client->visible)
+		return;
+
+	/* the timeout starts with the first client held */
+	if (transaction->clients == 0) {
+		transaction->start = get_time_nsec();
+		wl_event_source_timer_update(transaction->timer, TRANSACTION_TIMEOUT);
+	}
+
+	client_save_buffers(client);
+	client->in_transaction = true;
+	transaction->clients++;
+}
+
+void transaction_wait_client(struct jwc_client *client)
+{
+	struct jwc_transaction *transaction = client->server->transaction;
+
+	if (!client->in_transaction || client->transaction_pending)
+		return;
+
+	client->transaction_pending = true;
+	transaction->pending++;
+}
+
+void transaction_client_ready(struct jwc_client *client)
+{
+	struct jwc_transaction *transaction = client->server->transaction;
+
+	if (!client->transaction_pending)
+		return;
+
+	client->transaction_pending = false;
+	if (--transaction->pending == 0 && transaction->depth == 0)
+		transaction_release(transaction, false);
+}
+
+void transaction_remove_client(struct jwc_client *client)
+{
+	struct jwc_transaction *transaction = client->server->transaction;
+
+	if (!client->in_transaction)
+		return;
+
+	/* the other clients may only wait for this one */
+	transaction_client_ready(client);
+	if (!client->in_transaction)
+		return;
+
+	client->in_transaction = false;
+	client_drop_saved_buffers(client);
+	if (--transaction->clients == 0 && transaction->depth == 0)
+		wl_event_source_timer_update(transaction->timer, 0);
+}
+
+void transaction_print_stats(struct jwc_server *server)
+{
+	struct jwc_transaction *transaction = server->transaction;
+
+	INFO("Transactions: %llu, %llu timeouts", (unsigned long long)transaction->count,
+	     (unsigned long long)transaction->timeouts);
+	stats_log_print(&transaction->wait_hist, "wait");
+}
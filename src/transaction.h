@@ -0,0 +1,93 @@
+/*
+ * This file is part of the jwm distribution:
+ * https://github.com/JulienMasson/jwc
+ *
+ * Copyright (c) 2019 Julien Masson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include "server.h"
+#include "stats.h"
+
+/* time given to the clients to draw their new geometry (in ms) */
+#define TRANSACTION_TIMEOUT 200
+
+struct jwc_client;
+
+struct jwc_transaction {
+	/* pointer to compositor server */
+	struct jwc_server *server;
+
+	/* nesting of transaction_begin() / transaction_commit() */
+	int depth;
+
+	/* clients showing their previous state, and the ones among them
+	 * which have not yet committed their new size
+	 */
+	int clients, pending;
+	int64_t start;
+	struct wl_event_source *timer;
+
+	/* how long layout changes wait for the clients */
+	struct jwc_log_histogram wait_hist;
+	uint64_t count, timeouts;
+};
+
+/**
+ * Init the transaction of the server
+ */
+void transaction_init(struct jwc_server *server);
+
+/**
+ * Group the layout changes made between begin and commit: the clients
+ * changed meanwhile keep being displayed as they were until every client
+ * resized has drawn its new size (or TRANSACTION_TIMEOUT has expired), all
+ * changes are then displayed in the same frame. The other clients are not
+ * affected.
+ */
+void transaction_begin(struct jwc_server *server);
+void transaction_commit(struct jwc_server *server);
+
+/**
+ * The client is about to change, keep displaying its current state if a
+ * transaction is open.
+ */
+void transaction_add_client(struct jwc_client *client);
+
+/**
+ * The client has been asked to resize, wait for it if it is held by the
+ * transaction.
+ */
+void transaction_wait_client(struct jwc_client *client);
+
+/**
+ * The client has committed its new size
+ */
+void transaction_client_ready(struct jwc_client *client);
+
+/**
+ * The client is unmapped or destroyed: don't wait for it and stop
+ * displaying its previous state.
+ */
+void transaction_remove_client(struct jwc_client *client);
+
+/**
+ * Print how long the transactions have waited in the log
+ */
+void transaction_print_stats(struct jwc_server *server);
+
+#endif
@@ -18,6 +18,7 @@
  */
 
 #include <signal.h>
+#include <time.h>
 
 #include "utils.h"
 
@@ -25,3 +26,15 @@ void wait_for_debugger(void)
 {
 	raise(SIGSTOP);
 }
+
+int64_t timespec_to_nsec(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+int64_t get_time_nsec(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
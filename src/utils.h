@@ -26,6 +26,15 @@
 #define INFO(...)	wlr_log(WLR_INFO, __VA_ARGS__)
 #define DEBUG(...)	wlr_log(WLR_DEBUG, __VA_ARGS__)
 
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#define MAX(a, b)	((a) > (b) ? (a) : (b))
+
 void wait_for_debugger(void);
 
+/**
+ * Time helpers in nanoseconds
+ */
+int64_t timespec_to_nsec(const struct timespec *ts);
+int64_t get_time_nsec(void);
+
 #endif
@@ -18,6 +18,7 @@
  */
 
 #include "client.h"
+#include "transaction.h"
 #include "utils.h"
 
 static void xdg_surface_v6_close(struct jwc_client *client)
@@ -32,16 +33,42 @@ static void xdg_surface_v6_move(struct jwc_client *client, double x, double y)
 	client->y = y - client->xdg_surface_v6->geometry.y;
 }
 
+static uint32_t xdg_surface_v6_configure(struct jwc_client *client, double width,
+					 double height)
+{
+	uint32_t serial = wlr_xdg_toplevel_v6_set_size(client->xdg_surface_v6, width, height);
+
+	/* nothing sent if the size didn't change */
+	if (serial > 0) {
+		client->configure_serial = serial;
+		client->configure_time = get_time_nsec();
+	}
+
+	return serial;
+}
+
 static void xdg_surface_v6_resize(struct jwc_client *client, double width, double height)
 {
-	wlr_xdg_toplevel_v6_set_size(client->xdg_surface_v6, width, height);
+	/* slow clients would fall behind the interactive resize: keep the
+	 * latest size until the previous one has been drawn
+	 */
+	if (client->configure_serial > 0) {
+		client->resize_width = width;
+		client->resize_height = height;
+		client->resize_queued = true;
+		return;
+	}
+
+	xdg_surface_v6_configure(client, width, height);
 }
 
 static void xdg_surface_v6_move_resize(struct jwc_client *client, double x, double y,
 				       double width, double height)
 {
-	struct wlr_xdg_surface_v6 *surface = client->xdg_surface_v6;
-	uint32_t serial = wlr_xdg_toplevel_v6_set_size(surface, width, height);
+	/* this size replaces the one of the interactive resize */
+	client->resize_queued = false;
+
+	uint32_t serial = xdg_surface_v6_configure(client, width, height);
 	if (serial > 0) {
 		client->pending_geo.x = x;
 		client->pending_geo.y = y;
@@ -49,7 +76,7 @@ static void xdg_surface_v6_move_resize(struct jwc_client *client, double x, doub
 		client->pending_geo.height = height;
 		client->pending_serial = serial;
 	} else if (client->pending_serial == 0) {
-		client->move(client, x, y);
+		client->ops->move(client, x, y);
 	}
 }
 
@@ -87,6 +114,11 @@ static void xdg_surface_v6_get_geometry(struct jwc_client *client, struct wlr_bo
 	}
 }
 
+static const char *xdg_surface_v6_get_title(struct jwc_client *client)
+{
+	return client->xdg_surface_v6->toplevel->title;
+}
+
 static struct wlr_surface *xdg_surface_v6_surface_at(struct jwc_client *client,
 						     double sx, double sy,
 						     double *sub_x, double *sub_y)
@@ -110,51 +142,72 @@ static void xdg_surface_v6_commit_event(struct wl_listener *listener, void *data
 
 	uint32_t pending_serial = client->pending_serial;
 
+	client_commit(client);
+
+	/* the client has drawn the last configure sent */
+	if (client->configure_serial > 0 &&
+	    surface->configure_serial >= client->configure_serial) {
+		stats_log_add(&client->configure_hist, get_time_nsec() - client->configure_time);
+		client->configure_serial = 0;
+
+		if (client->resize_queued) {
+			client->resize_queued = false;
+			xdg_surface_v6_configure(client, client->resize_width,
+						 client->resize_height);
+		}
+	}
+
 	if (pending_serial > 0 && pending_serial >= surface->configure_serial) {
 
 		client_move(client, client->pending_geo.x, client->pending_geo.y);
 
-		if (pending_serial == surface->configure_serial)
+		if (pending_serial == surface->configure_serial) {
 			client->pending_serial = 0;
+			client_invalidate_geometry(client);
+			transaction_client_ready(client);
+		}
 	}
 }
 
+static const struct jwc_client_ops xdg_surface_v6_ops = {
+	.close = xdg_surface_v6_close,
+	.move = xdg_surface_v6_move,
+	.resize = xdg_surface_v6_resize,
+	.move_resize = xdg_surface_v6_move_resize,
+	.set_activated = xdg_surface_v6_set_activated,
+	.set_maximized = xdg_surface_v6_set_maximized,
+	.set_fullscreen = xdg_surface_v6_set_fullscreen,
+	.get_geometry = xdg_surface_v6_get_geometry,
+	.surface_at = xdg_surface_v6_surface_at,
+	.for_each_surface = xdg_surface_v6_for_each_surface,
+	.get_title = xdg_surface_v6_get_title,
+};
+
+static void xdg_surface_v6_ack_configure_event(struct wl_listener *listener, void *data)
+{
+	struct jwc_client *client = wl_container_of(listener, client, ack_configure);
+
+	/* the geometry no longer comes from the pending one once acked */
+	client_invalidate_geometry(client);
+}
+
+static void xdg_surface_v6_destroy_event(struct wl_listener *listener, void *data)
+{
+	struct jwc_client *client = wl_container_of(listener, client, destroy);
+	wl_list_remove(&client->ack_configure.link);
+	client_destroy_event(listener, data);
+}
+
 static void xdg_surface_v6_unmap_event(struct wl_listener *listener, void *data)
 {
 	struct jwc_client *client = wl_container_of(listener, client, unmap);
-	client->mapped = false;
+	client_unmap(client);
 }
 
 static void xdg_surface_v6_map_event(struct wl_listener *listener, void *data)
 {
 	struct jwc_client *client = wl_container_of(listener, client, map);
 
-	/* save surface */
-	client->surface = client->xdg_surface_v6->surface;
-
-	/* reference client features */
-	client->close = xdg_surface_v6_close;
-	client->move = xdg_surface_v6_move;
-	client->resize = xdg_surface_v6_resize;
-	client->move_resize = xdg_surface_v6_move_resize;
-	client->set_activated = xdg_surface_v6_set_activated;
-	client->set_maximized = xdg_surface_v6_set_maximized;
-	client->set_fullscreen = xdg_surface_v6_set_fullscreen;
-	client->get_geometry = xdg_surface_v6_get_geometry;
-	client->surface_at = xdg_surface_v6_surface_at;
-	client->for_each_surface = xdg_surface_v6_for_each_surface;
-
-	/* register callback for surface commit event */
-	client->surface_commit.notify = xdg_surface_v6_commit_event;
-	wl_signal_add(&client->surface->events.commit,
-		      &client->surface_commit);
-
-	client->unmap.notify = xdg_surface_v6_unmap_event;
-	wl_signal_add(&client->xdg_surface_v6->events.unmap, &client->unmap);
-
-	client->destroy.notify = client_destroy_event;
-	wl_signal_add(&client->xdg_surface_v6->events.destroy, &client->destroy);
-
 	client_setup(client);
 	client_center_on_cursor(client);
 }
@@ -175,11 +228,32 @@ static void xdg_shell_v6_new_surface_event(struct wl_listener *listener, void *d
 
 	struct jwc_client *client = calloc(1, sizeof(struct jwc_client));
 	client->server = server;
+	pixman_region32_init(&client->render_region);
 	client->xdg_surface_v6 = xdg_surface_v6;
 
-	/* register callbacks when we get events from this client */
+	/* save surface */
+	client->surface = xdg_surface_v6->surface;
+
+	/* reference client features */
+	client->ops = &xdg_surface_v6_ops;
+
+	/* register callbacks when we get events from this client, once: the
+	 * surface may be mapped and unmapped several times.
+	 */
 	client->map.notify = xdg_surface_v6_map_event;
 	wl_signal_add(&xdg_surface_v6->events.map, &client->map);
+
+	client->unmap.notify = xdg_surface_v6_unmap_event;
+	wl_signal_add(&xdg_surface_v6->events.unmap, &client->unmap);
+
+	client->surface_commit.notify = xdg_surface_v6_commit_event;
+	wl_signal_add(&client->surface->events.commit, &client->surface_commit);
+
+	client->ack_configure.notify = xdg_surface_v6_ack_configure_event;
+	wl_signal_add(&xdg_surface_v6->events.ack_configure, &client->ack_configure);
+
+	client->destroy.notify = xdg_surface_v6_destroy_event;
+	wl_signal_add(&xdg_surface_v6->events.destroy, &client->destroy);
 }
 
 void xdg_shell_v6_init(struct jwc_server *server)
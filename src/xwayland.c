@@ -18,6 +18,7 @@
  */
 
 #include "client.h"
+#include "transaction.h"
 #include "utils.h"
 
 static void xwayland_surface_close(struct jwc_client *client)
@@ -25,33 +26,77 @@ static void xwayland_surface_close(struct jwc_client *client)
 	wlr_xwayland_surface_close(client->xwayland_surface);
 }
 
-static void xwayland_surface_move(struct jwc_client *client, double x, double y)
+static void xwayland_surface_dequeue_configure(struct jwc_client *client)
+{
+	if (!client->x11_configure_queued)
+		return;
+
+	wl_list_remove(&client->x11_configure_link);
+	client->x11_configure_queued = false;
+}
+
+static void xwayland_surface_configure(struct jwc_client *client, double width,
+				       double height)
 {
 	struct wlr_xwayland_surface *xwayland_surface = client->xwayland_surface;
-	wlr_xwayland_surface_configure(xwayland_surface, x, y,
-				       xwayland_surface->width,
-				       xwayland_surface->height);
+	bool resized = width != xwayland_surface->width ||
+		       height != xwayland_surface->height;
+
+	/* the position is sent with the size */
+	xwayland_surface_dequeue_configure(client);
+	wlr_xwayland_surface_configure(xwayland_surface, client->x, client->y,
+				       width, height);
+
+	/* X11 has no configure serial: wait for the client to answer with a
+	 * new buffer (see xwayland_surface_commit_event)
+	 */
+	if (resized) {
+		client->pending_geo.width = width;
+		client->pending_geo.height = height;
+		client->x11_configure_width = client->surface->current.width;
+		client->x11_configure_height = client->surface->current.height;
+		client->x11_configure_commits = 0;
+		client->configure_serial++;
+		client->configure_time = get_time_nsec();
+	}
+}
+
+static void xwayland_surface_move(struct jwc_client *client, double x, double y)
+{
+	/* displayed right away, the X server only needs the final position */
 	client->x = x;
 	client->y = y;
+
+	if (!client->x11_configure_queued) {
+		wl_list_insert(&client->server->xwayland_configures,
+			       &client->x11_configure_link);
+		client->x11_configure_queued = true;
+	}
 }
 
 static void xwayland_surface_resize(struct jwc_client *client, double width, double height)
 {
-	wlr_xwayland_surface_configure(client->xwayland_surface, client->x, client->y,
-				       width, height);
+	xwayland_surface_configure(client, width, height);
 }
 
 static void xwayland_surface_move_resize(struct jwc_client *client, double x, double y,
 					 double width, double height)
 {
-	struct wlr_xwayland_surface *xwayland_surface = client->xwayland_surface;
-	wlr_xwayland_surface_configure(xwayland_surface, x, y, width, height);
+	client->x = x;
+	client->y = y;
+	xwayland_surface_configure(client, width, height);
+}
 
-	client->pending_geo.x = x;
-	client->pending_geo.y = y;
-	client->pending_geo.width = width;
-	client->pending_geo.height = height;
-	client->pending_serial = 1;
+void xwayland_flush_configures(struct jwc_server *server)
+{
+	struct jwc_client *client, *tmp;
+	struct wlr_xwayland_surface *xwayland_surface;
+
+	wl_list_for_each_safe(client, tmp, &server->xwayland_configures, x11_configure_link) {
+		xwayland_surface = client->xwayland_surface;
+		xwayland_surface_configure(client, xwayland_surface->width,
+					   xwayland_surface->height);
+	}
 }
 
 static void xwayland_surface_set_activated(struct jwc_client *client, bool activated)
@@ -73,12 +118,18 @@ static void xwayland_surface_get_geometry(struct jwc_client *client, struct wlr_
 {
 	struct wlr_xwayland_surface *surface = client->xwayland_surface;
 
-	box->x = surface->x;
-	box->y = surface->y;
+	/* the X server may not know yet where the window has been moved */
+	box->x = client->x;
+	box->y = client->y;
 	box->width = surface->width;
 	box->height = surface->height;
 }
 
+static const char *xwayland_surface_get_title(struct jwc_client *client)
+{
+	return client->xwayland_surface->title;
+}
+
 static struct wlr_surface *xwayland_surface_surface_at(struct jwc_client *client,
 						       double sx, double sy,
 						       double *sub_x, double *sub_y)
@@ -97,11 +148,30 @@ static void xwayland_surface_for_each_surface(struct jwc_client *client,
 static void xwayland_surface_commit_event(struct wl_listener *listener, void *data)
 {
 	struct jwc_client *client = wl_container_of(listener, client, surface_commit);
-	uint32_t pending_serial = client->pending_serial;
+	struct wlr_surface *surface = client->surface;
+
+	client_commit(client);
+
+	if (client->configure_serial == 0)
+		return;
 
-	if (pending_serial > 0) {
-		client_move(client, client->pending_geo.x, client->pending_geo.y);
-		client->pending_serial = 0;
+	/* the client has drawn the size requested, or another size if it has
+	 * clamped it (i.e. size hints). A buffer committed while the configure
+	 * was in flight can keep the old size once: after that the client has
+	 * ignored the request.
+	 */
+	int width = surface->current.width;
+	int height = surface->current.height;
+	bool requested = width == client->pending_geo.width &&
+			 height == client->pending_geo.height;
+	bool clamped = width != client->x11_configure_width ||
+		       height != client->x11_configure_height;
+	bool ignored = ++client->x11_configure_commits > 1;
+
+	if (requested || clamped || ignored) {
+		stats_log_add(&client->configure_hist, get_time_nsec() - client->configure_time);
+		client->configure_serial = 0;
+		transaction_client_ready(client);
 	}
 }
 
@@ -109,13 +179,17 @@ void xwayland_destroy_event(struct wl_listener *listener, void *data)
 {
 	struct jwc_client *client = wl_container_of(listener, client, destroy);
 	wl_list_remove(&client->request_configure.link);
+	xwayland_surface_dequeue_configure(client);
 	client_destroy_event(listener, data);
 }
 
 static void xwayland_unmap_event(struct wl_listener *listener, void *data)
 {
 	struct jwc_client *client = wl_container_of(listener, client, unmap);
-	client->mapped = false;
+
+	/* the queued position is dropped along with the configures not drawn */
+	xwayland_surface_dequeue_configure(client);
+	client_unmap(client);
 }
 
 static bool xwayland_is_focusable(struct jwc_client *client)
@@ -123,6 +197,21 @@ static bool xwayland_is_focusable(struct jwc_client *client)
 	return wlr_xwayland_or_surface_wants_focus(client->xwayland_surface);
 }
 
+static const struct jwc_client_ops xwayland_surface_ops = {
+	.close = xwayland_surface_close,
+	.move = xwayland_surface_move,
+	.resize = xwayland_surface_resize,
+	.move_resize = xwayland_surface_move_resize,
+	.set_activated = xwayland_surface_set_activated,
+	.set_maximized = xwayland_surface_set_maximized,
+	.set_fullscreen = xwayland_surface_set_fullscreen,
+	.get_geometry = xwayland_surface_get_geometry,
+	.surface_at = xwayland_surface_surface_at,
+	.for_each_surface = xwayland_surface_for_each_surface,
+	.is_focusable = xwayland_is_focusable,
+	.get_title = xwayland_surface_get_title,
+};
+
 static void xwayland_map_event(struct wl_listener *listener, void *data)
 {
 	struct jwc_client *client = wl_container_of(listener, client, map);
@@ -134,17 +223,7 @@ static void xwayland_map_event(struct wl_listener *listener, void *data)
 	client->y = xwayland_surface->y;
 
 	/* reference client features */
-	client->close = xwayland_surface_close;
-	client->move = xwayland_surface_move;
-	client->resize = xwayland_surface_resize;
-	client->move_resize = xwayland_surface_move_resize;
-	client->set_activated = xwayland_surface_set_activated;
-	client->set_maximized = xwayland_surface_set_maximized;
-	client->set_fullscreen = xwayland_surface_set_fullscreen;
-	client->get_geometry = xwayland_surface_get_geometry;
-	client->surface_at = xwayland_surface_surface_at;
-	client->for_each_surface = xwayland_surface_for_each_surface;
-	client->is_focusable = xwayland_is_focusable;
+	client->ops = &xwayland_surface_ops;
 
 	/* register callback for destroy and surface commit event */
 	client->surface_commit.notify = xwayland_surface_commit_event;
@@ -168,11 +247,16 @@ static void xwayland_request_configure_event(struct wl_listener *listener, void
 	struct wlr_xwayland_surface *xwayland_surface = client->xwayland_surface;
 	struct wlr_xwayland_surface_configure_event *event = data;
 
+	client_damage_whole(client);
 	client->x = event->x;
 	client->y = event->y;
 
+	xwayland_surface_dequeue_configure(client);
 	wlr_xwayland_surface_configure(xwayland_surface, event->x, event->y,
 				       event->width, event->height);
+	client_invalidate_geometry(client);
+	client_update_outputs(client);
+	client_damage_whole(client);
 }
 
 static void xwayland_new_surface_event(struct wl_listener *listener, void *data)
@@ -189,6 +273,7 @@ static void xwayland_new_surface_event(struct wl_listener *listener, void *data)
 	if (!client)
 		return;
 	client->server = server;
+	pixman_region32_init(&client->render_region);
 	client->xwayland_surface = xwayland_surface;
 
 	/* register callbacks when we get events from this client */
@@ -205,6 +290,8 @@ void xwayland_init(struct jwc_server *server)
 					       server->compositor, false);
 	wlr_xwayland_set_seat(server->xwayland, server->seat);
 
+	wl_list_init(&server->xwayland_configures);
+
 	server->xwayland_new_surface.notify = xwayland_new_surface_event;
 	wl_signal_add(&server->xwayland->events.new_surface,
 		      &server->xwayland_new_surface);
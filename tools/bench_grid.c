@@ -0,0 +1,161 @@
+/*
+ * This file is part of the jwm distribution:
+ * https://github.com/JulienMasson/jwc
+ *
+ * Copyright (c) 2019 Julien Masson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Microbenchmark of the clients spatial grid (src/grid.c) against the
+ * linear walk of the clients it replaced, for 1, 100 and 10k windows.
+ *
+ *   make bench_grid && ./bench_grid
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "grid.h"
+
+#define LAYOUT_WIDTH	(3 * 2560)
+#define LAYOUT_HEIGHT	1440
+#define LOOKUPS		1000000
+#define MOVES		100000
+
+struct window {
+	struct jwc_grid_item grid_item;
+	struct wlr_box box;
+	void (*get_geometry)(struct window *window, struct wlr_box *box);
+};
+
+static uint32_t seed = 1;
+
+static int rand_range(int min, int max)
+{
+	/* deterministic between runs */
+	seed = seed * 1103515245 + 12345;
+	return min + (int)((seed >> 8) % (uint32_t)(max - min + 1));
+}
+
+static int64_t now_nsec(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void window_get_geometry(struct window *window, struct wlr_box *box)
+{
+	*box = window->box;
+}
+
+/* what client_get_focus() did before the grid: every client from the
+ * toplevel one, geometry through a function pointer
+ */
+static struct window *linear_window_at(struct window **stack, int len, double x, double y)
+{
+	struct wlr_box box;
+
+	for (int i = 0; i < len; i++) {
+		stack[i]->get_geometry(stack[i], &box);
+		if ((x > box.x) && (y > box.y) &&
+		    (x < box.x + box.width) && (y < box.y + box.height))
+			return stack[i];
+	}
+
+	return NULL;
+}
+
+static void run(int len)
+{
+	struct jwc_grid *grid = grid_create();
+	struct window **stack = calloc(len, sizeof(*stack));
+	volatile uintptr_t sink = 0;
+	int64_t start, linear, indexed, moves;
+
+	if (!grid || !stack) {
+		fprintf(stderr, "allocation failed\n");
+		exit(1);
+	}
+
+	/* windows allocated one by one like the clients, stack[0] on top */
+	for (int i = 0; i < len; i++) {
+		struct window *window = calloc(1, sizeof(*window));
+		if (!window) {
+			fprintf(stderr, "allocation failed\n");
+			exit(1);
+		}
+		window->box.width = rand_range(200, 1200);
+		window->box.height = rand_range(150, 900);
+		window->box.x = rand_range(0, LAYOUT_WIDTH - window->box.width);
+		window->box.y = rand_range(0, LAYOUT_HEIGHT - window->box.height);
+		window->get_geometry = window_get_geometry;
+		window->grid_item.stack_index = i;
+		grid_update(grid, &window->grid_item, &window->box);
+		stack[i] = window;
+	}
+
+	/* the same random cursor positions for both lookups */
+	uint32_t lookup_seed = seed;
+
+	start = now_nsec();
+	for (int i = 0; i < LOOKUPS; i++) {
+		double x = rand_range(0, LAYOUT_WIDTH - 1) + 0.5;
+		double y = rand_range(0, LAYOUT_HEIGHT - 1) + 0.5;
+		sink += (uintptr_t)linear_window_at(stack, len, x, y);
+	}
+	linear = now_nsec() - start;
+
+	seed = lookup_seed;
+	start = now_nsec();
+	for (int i = 0; i < LOOKUPS; i++) {
+		double x = rand_range(0, LAYOUT_WIDTH - 1) + 0.5;
+		double y = rand_range(0, LAYOUT_HEIGHT - 1) + 0.5;
+		sink += (uintptr_t)grid_item_at(grid, x, y);
+	}
+	indexed = now_nsec() - start;
+
+	/* interactive move of the toplevel window, a few pixels per event */
+	struct window *dragged = stack[0];
+	start = now_nsec();
+	for (int i = 0; i < MOVES; i++) {
+		dragged->box.x = (dragged->box.x + 3) % (LAYOUT_WIDTH - dragged->box.width);
+		dragged->box.y = (dragged->box.y + 1) % (LAYOUT_HEIGHT - dragged->box.height);
+		grid_update(grid, &dragged->grid_item, &dragged->box);
+	}
+	moves = now_nsec() - start;
+
+	printf("%6d windows  linear %9.1f ns/lookup  grid %7.1f ns/lookup  "
+	       "grid update %7.1f ns/move\n", len,
+	       (double)linear / LOOKUPS, (double)indexed / LOOKUPS,
+	       (double)moves / MOVES);
+
+	for (int i = 0; i < len; i++)
+		free(stack[i]);
+	free(stack);
+	grid_destroy(grid);
+	(void)sink;
+}
+
+int main(void)
+{
+	int counts[] = { 1, 100, 10000 };
+
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+		run(counts[i]);
+
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * This file is part of the jwm distribution:
+ * https://github.com/JulienMasson/jwc
+ *
+ * Copyright (c) 2019 Julien Masson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stress test of the pointer coalescing (toggled with Meta+i): a virtual
+ * uinput mouse moves in circles at a high rate (8 kHz by default) while jwc
+ * runs on the DRM backend, then prints the rate it really achieved.
+ * jwc prints the motion received and processed, and how long processing
+ * took, on SIGUSR1:
+ *
+ *   make bench_motion
+ *   sudo ./bench_motion [rate in Hz] [duration in s] [scroll every n events]
+ *   pkill -USR1 jwc
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_RATE		8000
+#define DEFAULT_DURATION	10
+#define CIRCLE_RADIUS		300
+#define CIRCLE_PERIOD		1.0	/* seconds per turn */
+
+static int64_t timespec_to_nsec(struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static void nsec_to_timespec(int64_t nsec, struct timespec *ts)
+{
+	ts->tv_sec = nsec / 1000000000;
+	ts->tv_nsec = nsec % 1000000000;
+}
+
+static int emit(int fd, int type, int code, int value)
+{
+	struct input_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.type = type;
+	event.code = code;
+	event.value = value;
+
+	return write(fd, &event, sizeof(event)) == sizeof(event) ? 0 : -1;
+}
+
+static int uinput_create(void)
+{
+	struct uinput_setup setup;
+	int fd;
+
+	fd = open("/dev/uinput", O_WRONLY);
+	if (fd < 0) {
+		fprintf(stderr, "open /dev/uinput: %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* a button is needed to be seen as a pointer by libinput */
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
+	ioctl(fd, UI_SET_EVBIT, EV_REL);
+	ioctl(fd, UI_SET_RELBIT, REL_X);
+	ioctl(fd, UI_SET_RELBIT, REL_Y);
+	ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
+
+	memset(&setup, 0, sizeof(setup));
+	setup.id.bustype = BUS_USB;
+	setup.id.vendor = 0x1234;
+	setup.id.product = 0x5678;
+	snprintf(setup.name, UINPUT_MAX_NAME_SIZE, "jwc motion stress");
+
+	if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+		fprintf(stderr, "create uinput device: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int main(int argc, char *argv[])
+{
+	int rate = argc > 1 ? atoi(argv[1]) : DEFAULT_RATE;
+	int duration = argc > 2 ? atoi(argv[2]) : DEFAULT_DURATION;
+	int scroll = argc > 3 ? atoi(argv[3]) : 0;
+	int64_t period, start, deadline, late = 0, max_late = 0;
+	int x = CIRCLE_RADIUS, y = 0;
+	uint64_t events = 0;
+	struct timespec ts;
+	int fd;
+
+	if (rate <= 0 || duration <= 0) {
+		fprintf(stderr, "usage: %s [rate in Hz] [duration in s] [scroll every n events]\n",
+			argv[0]);
+		return 1;
+	}
+
+	fd = uinput_create();
+	if (fd < 0)
+		return 1;
+
+	/* let the compositor open the new device */
+	sleep(1);
+
+	period = 1000000000 / rate;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	start = timespec_to_nsec(&ts);
+	deadline = start;
+
+	while (deadline - start < (int64_t)duration * 1000000000) {
+		/* integer deltas along the circle, without drift */
+		double angle = 2 * M_PI * (deadline - start) / (CIRCLE_PERIOD * 1e9);
+		int next_x = lround(CIRCLE_RADIUS * cos(angle));
+		int next_y = lround(CIRCLE_RADIUS * sin(angle));
+
+		if (emit(fd, EV_REL, REL_X, next_x - x) < 0 ||
+		    emit(fd, EV_REL, REL_Y, next_y - y) < 0 ||
+		    (scroll > 0 && events % scroll == 0 &&
+		     emit(fd, EV_REL, REL_WHEEL, events / scroll % 2 ? 1 : -1) < 0) ||
+		    emit(fd, EV_SYN, SYN_REPORT, 0) < 0) {
+			fprintf(stderr, "write uinput event: %s\n", strerror(errno));
+			break;
+		}
+		x = next_x;
+		y = next_y;
+		events++;
+
+		/* absolute deadlines: a late event doesn't delay the next ones */
+		deadline += period;
+		nsec_to_timespec(deadline, &ts);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		late = timespec_to_nsec(&ts) - deadline;
+		if (late > max_late)
+			max_late = late;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	printf("%llu events in %.2fs: %.0f Hz (requested %d Hz), max late %.3fms\n",
+	       (unsigned long long)events, (timespec_to_nsec(&ts) - start) / 1e9,
+	       events / ((timespec_to_nsec(&ts) - start) / 1e9), rate, max_late / 1e6);
+
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+
+	return 0;
+}